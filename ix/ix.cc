@@ -1,6 +1,9 @@
 #include "ix.h"
 
 #include <cstring>
+#include <queue>
+
+#include <unistd.h>
 
 //IndexManager  ========================================================================================
 
@@ -33,6 +36,7 @@ RC IndexManager::createFile(const string &fileName) {
 
     IndexPage leaf(LeafPage, NULL, 0);
     if (leaf.write(file) != SUCCESS) return FAILURE;
+    if (pfm->closeFile(file) != SUCCESS) return FAILURE;
 
     fileName_ = fileName;
 
@@ -45,8 +49,8 @@ RC IndexManager::destroyFile(const string &fileName) {
     return SUCCESS;
 }
 
-RC IndexManager::openFile(const string &fileName, IXFileHandle &ixfileHandle) {
-    if (pfm->openFile(fileName, ixfileHandle.fileHandle) != SUCCESS) return FAILURE;
+RC IndexManager::openFile(const string &fileName, IXFileHandle &ixfileHandle, FileMode mode) {
+    if (pfm->openFile(fileName, ixfileHandle.fileHandle, mode) != SUCCESS) return FAILURE;
     fileName_ = fileName;
     return SUCCESS;
 }
@@ -98,11 +102,11 @@ RC IndexManager::insertEntry(IXFileHandle &ixfileHandle, const Attribute &attrib
         }
 
         //figure out which page the new key/value should be inserted at
-        it = page.find(attribute.type, k);
+        it = page.find(attribute.type, k.view());
         if (it != page.end(attribute.type)) {
             page.insert(it, k, v);
         } else {
-            it = splitPage.find(attribute.type, k);
+            it = splitPage.find(attribute.type, k.view());
             splitPage.insert(it, k, v);
         }
 
@@ -143,7 +147,7 @@ RC IndexManager::insertEntry(IXFileHandle &ixfileHandle, const Attribute &attrib
     }
 
     //at while loop exit find the spot for insertion and insert
-    auto it = page.find(attribute.type, k);
+    auto it = page.find(attribute.type, k.view());
     page.insert(it, k, v);
 
     //write to disk
@@ -151,14 +155,14 @@ RC IndexManager::insertEntry(IXFileHandle &ixfileHandle, const Attribute &attrib
 }
 
 RC IndexManager::deleteEntry(IXFileHandle &ixfileHandle, const Attribute &attribute, const void *key, const RID &rid) {
-    page_pointer_t deletePage = search(attribute.type, const_cast<void *>(key), ixfileHandle).back();
-    IndexPage temp{ixfileHandle.fileHandle, deletePage};
-    auto k = createKey(attribute.type, const_cast<void *>(key));
+    IndexPage temp;
+    auto k = createKeyView(attribute.type, key);
+    page_pointer_t deletePage = searchLeaf(attribute.type, k, ixfileHandle, temp);
     auto it = temp.find(attribute.type, k);
 
-    if (!areKeysEqual(attribute.type, k, it.getKey())) return FAILURE;
+    if (it == temp.end(attribute.type) || !areKeysEqual(attribute.type, k, it.getKeyView())) return FAILURE;
 
-    while (it != temp.end(attribute.type) && areKeysEqual(attribute.type, k, it.getKey())) {
+    while (it != temp.end(attribute.type) && areKeysEqual(attribute.type, k, it.getKeyView())) {
         //if rids are equal then delete
         if (it.getValue().rid.pageNum == rid.pageNum && it.getValue().rid.slotNum == rid.slotNum) {
             temp.erase(it);
@@ -189,11 +193,14 @@ void IndexManager::printBtree(IXFileHandle &ixfileHandle, const Attribute &attri
 
 //ScanIterator ========================================================================================
 
-IX_ScanIterator::IX_ScanIterator() {
+const size_t IX_ScanIterator::NO_LEVELS;
+
+IX_ScanIterator::IX_ScanIterator() : ix(NULL), internalLevels(NO_LEVELS), pathVersion(0) {
     im = IndexManager::instance();
 }
 
 IX_ScanIterator::~IX_ScanIterator() {
+    for (IndexManager::IndexPage *page : path) delete page;
 }
 
 RC IX_ScanIterator::getNextEntry(RID &rid, void *key) {
@@ -203,53 +210,25 @@ RC IX_ScanIterator::getNextEntry(RID &rid, void *key) {
             return IX_EOF;
         }
         startPage = temp.getNextPage();
-        temp.setData(ix->fileHandle, startPage);
+        temp.viewData(ix->fileHandle, startPage);
         start = temp.begin(attrType);
     }
 
-    auto key_ = start.getKey();
-    auto value = start.getValue();
-    //retrive entry as normal
-    if (startPage != endPage) {
-        rid.pageNum = value.rid.pageNum;
-        rid.slotNum = value.rid.slotNum;
-        formatKey(key_, key);
-        ++start;
-        return SUCCESS;
-    } else {
-        //if there is no highKey
-        if (highKey == nullptr) {
-            rid.pageNum = value.rid.pageNum;
-            rid.slotNum = value.rid.slotNum;
-            formatKey(key_, key);
-            ++start;
-            return SUCCESS;
-        } else {
-            if (highKeyInclusive) {
-                if (keyCmpLessEqual(key_, im->createKey(attrType, const_cast<void *>(highKey)))) {
-                    rid.pageNum = value.rid.pageNum;
-                    rid.slotNum = value.rid.slotNum;
-                    formatKey(key_, key);
-                    ++start;
-                    return SUCCESS;
-                } else {
-                    return IX_EOF;
-                }
-            } else {
-                if (keyCmpLess(key_, im->createKey(attrType, const_cast<void *>(highKey)))) {
-                    rid.pageNum = value.rid.pageNum;
-                    rid.slotNum = value.rid.slotNum;
-                    formatKey(key_, key);
-                    ++start;
-                    return SUCCESS;
-                } else {
-                    return IX_EOF;
-                }
-            }
-        }
+    auto key_ = start.getKeyView();
+
+    //only the last page can hold keys past the high key
+    if (startPage == endPage && highKey != nullptr) {
+        int cmp = IndexManager::IndexPage::compareKeys(attrType, key_, highKeyView);
+        if (cmp > 0 || (cmp == 0 && !highKeyInclusive)) return IX_EOF;
     }
 
-    return IX_EOF;
+    //retrive entry as normal
+    auto value = start.getValue();
+    rid.pageNum = value.rid.pageNum;
+    rid.slotNum = value.rid.slotNum;
+    formatKey(key_, key);
+    ++start;
+    return SUCCESS;
 }
 
 RC IX_ScanIterator::close() {
@@ -269,63 +248,126 @@ RC IX_ScanIterator::scanInit(IXFileHandle &ixfileHandle_,
     //set all the private variables
     ix = &ixfileHandle_;
     attrType = attrType_;
+
+    //pages cached from another file are no use
+    pathPages.clear();
+    internalLevels = NO_LEVELS;
+
+    return reset(lowKey_, highKey_, lowKeyInclusive_, highKeyInclusive_);
+}
+
+RC IX_ScanIterator::reset(const void *lowKey_,
+                          const void *highKey_,
+                          bool lowKeyInclusive_,
+                          bool highKeyInclusive_) {
     lowKey = lowKey_;
     highKey = highKey_;
     lowKeyInclusive = lowKeyInclusive_;
     highKeyInclusive = highKeyInclusive_;
 
+    //parse the high key once for the whole scan
+    if (highKey != nullptr) {
+        highKeyView = im->createKeyView(attrType, highKey);
+    }
+
+    //find the last page first so temp is left holding the first one
+    if (highKey == nullptr) {
+        endPage = getRightPage();
+    } else {
+        endPage = searchLeaf(highKeyView);
+    }
+
     //set the initial state
-    IndexManager::IndexPage::key k;
     if (lowKey == nullptr) {
         startPage = getLeftPage();
-        temp.setData(ix->fileHandle, startPage);
         start = temp.begin(attrType);
     } else {
-        startPage = im->search(attrType, const_cast<void *>(lowKey), *ix).back();
-        temp.setData(ix->fileHandle, startPage);
-        k = im->createKey(attrType, const_cast<void *>(lowKey));
+        auto k = im->createKeyView(attrType, lowKey);
+        //a search for a single key starts on the leaf already found for the high key
+        if (highKey != nullptr && IndexManager::IndexPage::compareKeys(attrType, k, highKeyView) == 0) {
+            startPage = endPage;
+        } else {
+            startPage = searchLeaf(k);
+        }
         start = temp.find(attrType, k);
+
+        if (!lowKeyInclusive) {
+            while (start != temp.end(attrType) && im->areKeysEqual(attrType, start.getKeyView(), k)) {
+                ++start;
+            }
+        }
     }
 
-    if (highKey == nullptr) {
-        endPage = getRightPage();
-    } else {
-        endPage = im->search(attrType, const_cast<void *>(highKey), *ix).back();
+    return SUCCESS;
+}
+
+//Same as IndexManager::searchLeaf, leaving the leaf in temp, but internal pages come from path when they were read before
+page_pointer_t IX_ScanIterator::searchLeaf(const IndexManager::IndexPage::key_view &k) {
+    //cached pages can't be trusted once the file has been written to, through this handle or any other
+    unsigned version = ix->fileHandle.getFileVersion();
+    if (version != pathVersion) {
+        pathPages.clear();
+        internalLevels = NO_LEVELS;
+        pathVersion = version;
     }
 
-    if (lowKey != nullptr && !lowKeyInclusive) {
-        auto currKey = start.getKey();
-        while (start != temp.end(attrType) && im->areKeysEqual(attrType, currKey, k)) {
-            ++start;
+    page_pointer_t pageNum = 0;
+    for (size_t level = 0;; level++) {
+        if (level == internalLevels) {
+            temp.viewData(ix->fileHandle, pageNum);
+            return pageNum;
         }
-    }
 
-    return SUCCESS;
+        //read the page unless it is the one cached for this level
+        if (level == pathPages.size() || pathPages[level] != pageNum) {
+            if (level == path.size()) path.push_back(new IndexManager::IndexPage());
+            path[level]->viewData(ix->fileHandle, pageNum);
+
+            if (path[level]->getType() == LeafPage) {
+                internalLevels = level;
+                pathPages.resize(level);
+                temp.viewData(ix->fileHandle, pageNum);
+                return pageNum;
+            }
+
+            if (level == pathPages.size()) {
+                pathPages.push_back(pageNum);
+            } else {
+                pathPages[level] = pageNum;
+            }
+        }
+
+        //go right of a separator equal to the key
+        IndexManager::IndexPage &page = *path[level];
+        IndexManager::IndexPage::iterator it = page.find(attrType, k);
+        if (it != page.end(attrType) && im->areKeysEqual(attrType, it.getKeyView(), k)) ++it;
+        pageNum = it.getValue().pnum;
+    }
 }
 
 page_pointer_t IX_ScanIterator::getLeftPage() {
-    IndexManager::IndexPage temp(ix->fileHandle, 0);
+    temp.viewData(ix->fileHandle, 0);
     page_pointer_t left = 0;
     while (temp.getType() != LeafPage) {
         auto it = temp.begin(attrType);
         left = it.getValue().pnum;
-        temp.setData(ix->fileHandle, left);
+        temp.viewData(ix->fileHandle, left);
     }
     return left;
 }
 
 page_pointer_t IX_ScanIterator::getRightPage() {
-    IndexManager::IndexPage temp(ix->fileHandle, 0);
+    temp.viewData(ix->fileHandle, 0);
     page_pointer_t right = 0;
     while (temp.getType() != LeafPage) {
         auto it = temp.end(attrType);
         right = it.getValue().pnum;
-        temp.setData(ix->fileHandle, right);
+        temp.viewData(ix->fileHandle, right);
     }
     return right;
 }
 
-void IX_ScanIterator::formatKey(IndexManager::IndexPage::key k, void *dest) {
+void IX_ScanIterator::formatKey(const IndexManager::IndexPage::key_view &k, void *dest) {
     switch (attrType) {
         case AttrType::TypeInt:
             memcpy(dest, &k.i, INT_SIZE);
@@ -334,43 +376,295 @@ void IX_ScanIterator::formatKey(IndexManager::IndexPage::key k, void *dest) {
             memcpy(dest, &k.r, REAL_SIZE);
             break;
         case AttrType::TypeVarChar:
-            int length = k.s.length();
-            memcpy(dest, &length, VARCHAR_LENGTH_SIZE);
-            memcpy(static_cast<char *>(dest) + VARCHAR_LENGTH_SIZE, k.s.c_str(), length);
+            memcpy(dest, &k.len, VARCHAR_LENGTH_SIZE);
+            memcpy(static_cast<char *>(dest) + VARCHAR_LENGTH_SIZE, k.s, k.len);
             break;
     }
 }
 
-bool IX_ScanIterator::keyCmpLess(IndexManager::IndexPage::key key1, IndexManager::IndexPage::key key2) {
-    switch (attrType) {
-        case AttrType::TypeInt:
-            if (key1.i < key2.i) return true;
-            break;
-        case AttrType::TypeReal:
-            if (key1.r < key2.r) return true;
-            break;
-        case AttrType::TypeVarChar:
-            if (key1.s.compare(key2.s) < 0) return true;
-            break;
+
+//IX_BulkLoader =======================================================================================
+
+unsigned IX_BulkLoader::runCounter = 0;
+
+IX_BulkLoader::IX_BulkLoader(IXFileHandle &ixfileHandle, const Attribute &attribute, float fillFactor)
+    : ix(&ixfileHandle), attrType(attribute.type), leafSize(0), lastEntry(0), leafPage(NULL_PAGE), pendingPage(NULL_PAGE) {
+    pageLimit = min((size_t)PAGE_SIZE, (size_t)max(fillFactor * PAGE_SIZE, 0.0f));
+}
+
+IX_BulkLoader::~IX_BulkLoader() {
+    removeRuns();
+}
+
+RC IX_BulkLoader::addEntry(const void *key, const RID &rid) {
+    //entry has to fit on a leaf by itself
+    const char *k = static_cast<const char *>(key);
+    size_t keySize = getKeySize(k);
+    if (sizeof(page_metadata_t) + sizeof(page_pointer_t) * 2 + keySize + sizeof(RID) > PAGE_SIZE) return FAILURE;
+
+    entries.push_back(buffer.size());
+    buffer.insert(buffer.end(), k, k + keySize);
+    const char *r = reinterpret_cast<const char *>(&rid);
+    buffer.insert(buffer.end(), r, r + sizeof(RID));
+
+    //write out a sorted run once the buffer is full
+    if (buffer.size() >= IX_BULK_BUFFER_SIZE) return writeRun();
+    return SUCCESS;
+}
+
+RC IX_BulkLoader::finish() {
+    //only an index that was just created can be bulk loaded
+    if (ix->fileHandle.getNumberOfPages() != 2) return FAILURE;
+    IndexManager::IndexPage first(ix->fileHandle, 1);
+    if (first.begin(attrType) != first.end(attrType)) return FAILURE;
+
+    //everything fit in memory, so skip the runs
+    RC rc;
+    if (runs.empty()) {
+        sortEntries();
+        for (size_t i = 0; i < entries.size(); i++) {
+            if ((rc = addToLeaf(&buffer[entries[i]]))) return rc;
+        }
+    } else {
+        if ((rc = writeRun())) return rc;
+        if ((rc = mergeRuns())) return rc;
     }
-    return false;
+    removeRuns();
+    buffer.clear();
+    entries.clear();
+
+    //no entries, the empty leaf from createFile stays
+    if (leafPage == NULL_PAGE) return SUCCESS;
+
+    if ((rc = writeLeaf(NULL_PAGE))) return rc;
+    if ((rc = buildInternalLevels())) return rc;
+    return writePending();
 }
 
-bool IX_ScanIterator::keyCmpLessEqual(IndexManager::IndexPage::key key1, IndexManager::IndexPage::key key2) {
-    switch (attrType) {
-        case AttrType::TypeInt:
-            if (key1.i <= key2.i) return true;
-            break;
-        case AttrType::TypeReal:
-            if (key1.r <= key2.r) return true;
-            break;
-        case AttrType::TypeVarChar:
-            if (key1.s.compare(key2.s) <= 0) return true;
-            break;
+size_t IX_BulkLoader::getKeySize(const char *entry) const {
+    if (attrType != TypeVarChar) return INT_SIZE;
+
+    unsigned len;
+    memcpy(&len, entry, VARCHAR_LENGTH_SIZE);
+    return VARCHAR_LENGTH_SIZE + len;
+}
+
+int IX_BulkLoader::compareEntries(const char *entry1, const char *entry2) const {
+    key_view k1 = IndexManager::IndexPage::readKey(attrType, entry1);
+    key_view k2 = IndexManager::IndexPage::readKey(attrType, entry2);
+    int cmp = IndexManager::IndexPage::compareKeys(attrType, k1, k2);
+    if (cmp != 0) return cmp;
+
+    //order equal keys by RID so the table is read back in file order
+    RID r1, r2;
+    memcpy(&r1, entry1 + getKeySize(entry1), sizeof(RID));
+    memcpy(&r2, entry2 + getKeySize(entry2), sizeof(RID));
+    if (r1.pageNum != r2.pageNum) return (r1.pageNum > r2.pageNum) - (r1.pageNum < r2.pageNum);
+    return (r1.slotNum > r2.slotNum) - (r1.slotNum < r2.slotNum);
+}
+
+void IX_BulkLoader::sortEntries() {
+    const char *base = buffer.data();
+    sort(entries.begin(), entries.end(), [this, base](size_t a, size_t b) {
+        return compareEntries(base + a, base + b) < 0;
+    });
+}
+
+RC IX_BulkLoader::writeRun() {
+    if (entries.empty()) return SUCCESS;
+    sortEntries();
+
+    PagedFileManager *pfm = PagedFileManager::instance();
+    Run *run = new Run;
+    run->fileName = IX_BULK_RUN_PREFIX + to_string(getpid()) + "_" + to_string(runCounter++);
+    runs.push_back(run);
+    if (pfm->createFile(run->fileName) != SUCCESS) return FAILURE;
+    if (pfm->openFile(run->fileName, run->fileHandle) != SUCCESS) return FAILURE;
+
+    //each page starts with the number of bytes used on it
+    uint32_t used = sizeof(uint32_t);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const char *entry = &buffer[entries[i]];
+        size_t size = getKeySize(entry) + sizeof(RID);
+        if (used + size > PAGE_SIZE) {
+            memcpy(run->page, &used, sizeof(uint32_t));
+            if (run->fileHandle.appendPage(run->page) != SUCCESS) return FAILURE;
+            used = sizeof(uint32_t);
+        }
+        memcpy(run->page + used, entry, size);
+        used += size;
+    }
+    memcpy(run->page, &used, sizeof(uint32_t));
+    if (run->fileHandle.appendPage(run->page) != SUCCESS) return FAILURE;
+
+    buffer.clear();
+    entries.clear();
+    return SUCCESS;
+}
+
+RC IX_BulkLoader::advanceRun(Run *run, bool &hasEntry) {
+    //move on to the next page once this one is used up
+    uint32_t used;
+    memcpy(&used, run->page, sizeof(uint32_t));
+    while (run->offset >= used) {
+        if (run->pageNum + 1 >= run->fileHandle.getNumberOfPages()) {
+            hasEntry = false;
+            return SUCCESS;
+        }
+        if (run->fileHandle.readPage(++run->pageNum, run->page) != SUCCESS) return FAILURE;
+        memcpy(&used, run->page, sizeof(uint32_t));
+        run->offset = sizeof(uint32_t);
     }
-    return false;
+    hasEntry = true;
+    return SUCCESS;
 }
 
+bool IX_BulkLoader::RunGreater::operator()(const Run *a, const Run *b) const {
+    return loader->compareEntries(a->page + a->offset, b->page + b->offset) > 0;
+}
+
+RC IX_BulkLoader::mergeRuns() {
+    RunGreater greater = {this};
+    priority_queue<Run *, vector<Run *>, RunGreater> heap(greater);
+
+    bool hasEntry;
+    for (size_t i = 0; i < runs.size(); i++) {
+        Run *run = runs[i];
+        run->pageNum = 0;
+        if (run->fileHandle.readPage(0, run->page) != SUCCESS) return FAILURE;
+        run->offset = sizeof(uint32_t);
+        if (advanceRun(run, hasEntry) != SUCCESS) return FAILURE;
+        if (hasEntry) heap.push(run);
+    }
+
+    //repeatedly take the smallest entry of any run
+    RC rc;
+    while (!heap.empty()) {
+        Run *run = heap.top();
+        heap.pop();
+
+        const char *entry = run->page + run->offset;
+        if ((rc = addToLeaf(entry))) return rc;
+        run->offset += getKeySize(entry) + sizeof(RID);
+
+        if (advanceRun(run, hasEntry) != SUCCESS) return FAILURE;
+        if (hasEntry) heap.push(run);
+    }
+    return SUCCESS;
+}
+
+RC IX_BulkLoader::addToLeaf(const char *entry) {
+    size_t keySize = getKeySize(entry);
+    size_t size = keySize + sizeof(RID);
+    size_t used = sizeof(page_metadata_t) + sizeof(page_pointer_t) * 2 + leafSize + size;
+
+    //first leaf replaces the empty one from createFile
+    if (leafPage == NULL_PAGE) {
+        leafPage = 1;
+    } else if (leafSize > 0 && used > pageLimit) {
+        //equal keys stay on one leaf while there is room, since the parent sends lookups of the first key right
+        key_view k = IndexManager::IndexPage::readKey(attrType, entry);
+        key_view last = IndexManager::IndexPage::readKey(attrType, leaf + lastEntry);
+        if (used > PAGE_SIZE || IndexManager::IndexPage::compareKeys(attrType, k, last) != 0) {
+            RC rc = writeLeaf(leafPage + 1);
+            if (rc) return rc;
+            leafPage++;
+            leafSize = 0;
+        }
+    }
+
+    if (leafSize == 0) children.push_back(make_pair(string(entry, keySize), leafPage));
+    lastEntry = leafSize;
+    memcpy(leaf + leafSize, entry, size);
+    leafSize += size;
+    return SUCCESS;
+}
+
+RC IX_BulkLoader::writeLeaf(page_pointer_t next) {
+    //leaves are numbered left to right starting at page 1
+    page_pointer_t prev = (leafPage > 1) ? leafPage - 1 : NULL_PAGE;
+    IndexManager::IndexPage page(LeafPage, leaf, leafSize, next, prev);
+    return writePage(leafPage, page);
+}
+
+//Pages are collected until IX_BULK_WRITE_PAGES consecutive ones can be written together
+RC IX_BulkLoader::writePage(page_pointer_t pageNum, const IndexManager::IndexPage &page) {
+    if (!pending.empty() && pageNum != pendingPage + (page_pointer_t)(pending.size() / PAGE_SIZE)) {
+        RC rc = writePending();
+        if (rc) return rc;
+    }
+
+    if (pending.empty()) pendingPage = pageNum;
+    pending.insert(pending.end(), page.getData(), page.getData() + PAGE_SIZE);
+    if (pending.size() == IX_BULK_WRITE_PAGES * PAGE_SIZE) return writePending();
+    return SUCCESS;
+}
+
+RC IX_BulkLoader::writePending() {
+    if (pending.empty()) return SUCCESS;
+    RC rc = ix->fileHandle.writePages(pendingPage, pending.data(), pending.size() / PAGE_SIZE);
+    pending.clear();
+    return rc;
+}
+
+RC IX_BulkLoader::buildInternalLevels() {
+    //internal pages go after the leaves, except for the top level which is written to the root at page 0
+    RC rc = writePending();
+    if (rc) return rc;
+    page_pointer_t nextPage = ix->fileHandle.getNumberOfPages();
+    char page[PAGE_SIZE];
+    while (true) {
+        //the level fits in the root
+        size_t total = sizeof(page_metadata_t) + sizeof(page_pointer_t);
+        for (size_t i = 1; i < children.size(); i++) {
+            total += children[i].first.size() + sizeof(page_pointer_t);
+        }
+        bool isRoot = total <= PAGE_SIZE;
+        size_t limit = isRoot ? PAGE_SIZE : pageLimit;
+
+        //each page takes the first child as its leftmost pointer, then (key, pointer) entries
+        vector<pair<string, page_pointer_t> > parents;
+        size_t i = 0;
+        while (i < children.size()) {
+            string firstKey = children[i].first;
+            memcpy(page, &children[i].second, sizeof(page_pointer_t));
+            size_t size = sizeof(page_pointer_t);
+            i++;
+
+            while (i < children.size()) {
+                size_t entrySize = children[i].first.size() + sizeof(page_pointer_t);
+                size_t used = sizeof(page_metadata_t) + size + entrySize;
+                //always take at least one entry so every level shrinks
+                if (used > PAGE_SIZE || (used > limit && size > sizeof(page_pointer_t))) break;
+
+                memcpy(page + size, children[i].first.data(), children[i].first.size());
+                memcpy(page + size + children[i].first.size(), &children[i].second, sizeof(page_pointer_t));
+                size += entrySize;
+                i++;
+            }
+
+            page_pointer_t pageNum = isRoot ? 0 : nextPage++;
+            IndexManager::IndexPage internal(InternalPage, page, size);
+            if (writePage(pageNum, internal) != SUCCESS) return FAILURE;
+            parents.push_back(make_pair(firstKey, pageNum));
+        }
+
+        if (isRoot) return SUCCESS;
+        children.swap(parents);
+    }
+}
+
+void IX_BulkLoader::removeRuns() {
+    PagedFileManager *pfm = PagedFileManager::instance();
+    for (size_t i = 0; i < runs.size(); i++) {
+        pfm->closeFile(runs[i]->fileHandle);
+        pfm->destroyFile(runs[i]->fileName);
+        delete runs[i];
+    }
+    runs.clear();
+}
+
+
 //IXFileHandle =========================================================================================
 
 IXFileHandle::IXFileHandle() {
@@ -391,22 +685,11 @@ RC IXFileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePa
 }
 
 //IndexManager helper functions ========================================================================
-bool IndexManager::areKeysEqual(AttrType attrType, IndexPage::key key1, IndexPage::key key2) const {
-    switch (attrType) {
-        case AttrType::TypeInt:
-            if (key1.i == key2.i) return true;
-            break;
-        case AttrType::TypeReal:
-            if (key1.r == key2.r) return true;
-            break;
-        case AttrType::TypeVarChar:
-            if (key1.s == key2.s) return true;
-            break;
-    }
-    return false;
+bool IndexManager::areKeysEqual(AttrType attrType, const IndexPage::key_view &key1, const IndexPage::key_view &key2) const {
+    return IndexPage::compareKeys(attrType, key1, key2) == 0;
 }
 
-void IndexManager::printKey(AttrType attrType, IndexPage::key k) const {
+void IndexManager::printKey(AttrType attrType, const IndexPage::key_view &k) const {
     switch (attrType) {
         case AttrType::TypeInt:
             cout << k.i;
@@ -415,7 +698,7 @@ void IndexManager::printKey(AttrType attrType, IndexPage::key k) const {
             cout << k.r;
             break;
         case AttrType::TypeVarChar:
-            cout << k.s;
+            cout.write(k.s, k.len);
             break;
     }
 }
@@ -443,32 +726,43 @@ IndexManager::IndexPage::key IndexManager::createKey(AttrType attrType, void *ke
     }
 }
 
+IndexManager::IndexPage::key_view IndexManager::createKeyView(AttrType attrType, const void *key) const {
+    return IndexPage::readKey(attrType, static_cast<const char *>(key));
+}
+
 vector<page_pointer_t> IndexManager::search(AttrType attrType, void *key, IXFileHandle &ixfileHandle) {
-    //create indexPage object
-    IndexPage temp(ixfileHandle.fileHandle, 0);
+    IndexPage temp;
     vector<page_pointer_t> result;
+    searchLeaf(attrType, createKeyView(attrType, key), ixfileHandle, temp, &result);
+    return result;
+}
 
-    //parse the search key into a struct
-    IndexPage::key k = createKey(attrType, key);
-
+//Descend from the root to the leaf page that should hold k, leaving that leaf in page.
+//If path is given every page visited is appended to it, root first
+page_pointer_t IndexManager::searchLeaf(AttrType attrType, const IndexPage::key_view &k, IXFileHandle &ixfileHandle,
+                                        IndexPage &page, vector<page_pointer_t> *path) {
     //start at the root
-    result.push_back(0);
-    while (temp.getType() != LeafPage) {
-        IndexPage::iterator it = temp.find(attrType, k);
+    page_pointer_t pageNum = 0;
+    page.setData(ixfileHandle.fileHandle, pageNum);
+    if (path) path->push_back(pageNum);
+
+    while (page.getType() != LeafPage) {
+        IndexPage::iterator it = page.find(attrType, k);
         /*
             case 1: it = end, so no need to increment
             case 2: it != end, so no need to increment unless search keys are equal
         */
-        if (it != temp.end(attrType)) {
-            if (areKeysEqual(attrType, it.getKey(), k)) ++it;
+        if (it != page.end(attrType)) {
+            if (areKeysEqual(attrType, it.getKeyView(), k)) ++it;
         }
 
-        result.push_back(it.getValue().pnum);
-        temp.setData(ixfileHandle.fileHandle, it.getValue().pnum);
+        pageNum = it.getValue().pnum;
+        if (path) path->push_back(pageNum);
+        page.setData(ixfileHandle.fileHandle, pageNum);
     }
 
     //return the leaf page
-    return result;
+    return pageNum;
 }
 
 ssize_t IndexManager::getRecordSize(IndexPage::key k, AttrType attrType, IndexPage::value v, PageType pageType) {
@@ -498,7 +792,7 @@ void IndexManager::printHelper(int numSpaces, IXFileHandle &ixfileHandle, AttrTy
     //base case
     if (page.getType() == LeafPage) {
         auto it = page.begin(attrType);
-        auto prevKey = it.getKey();
+        auto prevKey = it.getKeyView();
 
         cout << " [\"";
         printKey(attrType, prevKey);
@@ -506,7 +800,7 @@ void IndexManager::printHelper(int numSpaces, IXFileHandle &ixfileHandle, AttrTy
 
         string comma = "";
         while (it != page.end(attrType)) {
-            auto key = it.getKey();
+            auto key = it.getKeyView();
             auto val = it.getValue();
 
             if (areKeysEqual(attrType, prevKey, key)) {
@@ -531,7 +825,7 @@ void IndexManager::printHelper(int numSpaces, IXFileHandle &ixfileHandle, AttrTy
     cout << "[";
     string comma = "";
     while (it != page.end(attrType)) {
-        auto key = it.getKey();
+        auto key = it.getKeyView();
         cout << comma << "\"";
         printKey(attrType, key);
         cout << "\"";
@@ -586,12 +880,25 @@ IndexManager::IndexPage::IndexPage(PageType type, void *initial_data, size_t dat
 }
 
 void IndexManager::IndexPage::setupPointers() {
-    data = static_cast<char *>(aligned_alloc(sizeof(page_metadata_t), PAGE_SIZE));
+    buffer = static_cast<char *>(aligned_alloc(sizeof(page_metadata_t), PAGE_SIZE));
+    pointTo(buffer);
+}
+
+void IndexManager::IndexPage::pointTo(char *page) {
+    data = page;
     metadata = reinterpret_cast<page_metadata_t *>(data);
     prev = reinterpret_cast<page_pointer_t *>(metadata + 1);
     next = reinterpret_cast<page_pointer_t *>(prev + 1);
 }
 
+RC IndexManager::IndexPage::viewData(FileHandle &file, size_t page_num) {
+    void *page;
+    RC rc = file.viewPage(page_num, buffer, page);
+    if (rc) return rc;
+    pointTo(static_cast<char *>(page));
+    return SUCCESS;
+}
+
 RC IndexManager::IndexPage::write(FileHandle &file, ssize_t page_num) const {
     if (page_num >= 0) return file.writePage(page_num, data);
     return file.appendPage(data);
@@ -678,25 +985,79 @@ IndexManager::IndexPage IndexManager::IndexPage::split(iterator &it) {
     return {getType(), it.where, removed_data};
 }
 
-IndexManager::IndexPage::iterator IndexManager::IndexPage::find(AttrType attr_type, key &search_key) const {
-    iterator it = begin(attr_type);
-    while (it != end(attr_type)) {
-        switch (it.attr_type) {
-            case AttrType::TypeInt:
-                if (it.getKey().i >= search_key.i) return it;
-                break;
-            case AttrType::TypeReal:
-                if (it.getKey().r >= search_key.r) return it;
-                break;
-            case AttrType::TypeVarChar:
-                if (it.getKey().s.compare(search_key.s) >= 0) return it;
-                break;
+IndexManager::IndexPage::iterator IndexManager::IndexPage::find(AttrType attr_type, const key_view &search_key) const {
+    //Binary search for the first entry whose key is not less than search_key
+    iterator first = begin(attr_type);
+    size_t entries_begin = first.getOffset();
+    size_t lo = 0;
+
+    if (attr_type == AttrType::TypeVarChar) {
+        //Varchar entries vary in size, so collect where each one starts first
+        size_t offsets[PAGE_SIZE / (VARCHAR_LENGTH_SIZE + sizeof(page_pointer_t))];
+        size_t entries = 0;
+        for (iterator it = first; it != end(attr_type); ++it) {
+            offsets[entries++] = it.getOffset();
+        }
+
+        size_t hi = entries;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (compareKeys(attr_type, readKey(attr_type, data + offsets[mid]), search_key) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return iterator(attr_type, first.page_type, (lo < entries) ? offsets[lo] : getOffset(), data);
+    }
+
+    //Int and real entries all have the same size
+    size_t entry_size = first.calcNextEntrySize();
+    size_t hi = (getOffset() - entries_begin) / entry_size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (compareKeys(attr_type, readKey(attr_type, data + entries_begin + mid * entry_size), search_key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-        ++it;
     }
-    return it;
+    return iterator(attr_type, first.page_type, entries_begin + lo * entry_size, data);
 };
 
+IndexManager::IndexPage::key_view IndexManager::IndexPage::readKey(AttrType attr_type, const char *where) {
+    key_view k = {0, 0, NULL, 0};
+    switch (attr_type) {
+        case AttrType::TypeInt:
+            memcpy(&k.i, where, INT_SIZE);
+            break;
+        case AttrType::TypeReal:
+            memcpy(&k.r, where, REAL_SIZE);
+            break;
+        case AttrType::TypeVarChar:
+            memcpy(&k.len, where, VARCHAR_LENGTH_SIZE);
+            k.s = where + VARCHAR_LENGTH_SIZE;
+            break;
+    }
+    return k;
+}
+
+int IndexManager::IndexPage::compareKeys(AttrType attr_type, const key_view &key1, const key_view &key2) {
+    switch (attr_type) {
+        case AttrType::TypeInt:
+            return (key1.i > key2.i) - (key1.i < key2.i);
+        case AttrType::TypeReal:
+            return (key1.r > key2.r) - (key1.r < key2.r);
+        case AttrType::TypeVarChar: {
+            //Same ordering as string::compare
+            int cmp = memcmp(key1.s, key2.s, min(key1.len, key2.len));
+            if (cmp != 0) return cmp;
+            return (key1.len > key2.len) - (key1.len < key2.len);
+        }
+    }
+    return 0;
+}
+
 //IndexManager::IndexPage::iterator ====================================================================
 
 IndexManager::IndexPage::value IndexManager::IndexPage::iterator::getValue() const {
@@ -5,6 +5,7 @@
 #include <sys/types.h>
 
 #include <cmath>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <string>
@@ -19,6 +20,12 @@
 
 #define NULL_PAGE -1
 
+//Bulk loading
+#define IX_DEFAULT_FILL_FACTOR 0.9              //Fraction of each page filled by IX_BulkLoader
+#define IX_BULK_BUFFER_SIZE (4 * 1024 * 1024)   //Bytes of entries sorted in memory before a run is written out
+#define IX_BULK_RUN_PREFIX "ix_bulk_run_"       //Temporary sorted run files
+#define IX_BULK_WRITE_PAGES 32                  //Consecutive pages written together with one request
+
 //Page attribute types
 typedef uint32_t page_metadata_t;
 typedef int32_t page_pointer_t;
@@ -61,7 +68,8 @@ class IndexManager {
     RC destroyFile(const string &fileName);
 
     // Open an index and return an ixfileHandle.
-    RC openFile(const string &fileName, IXFileHandle &ixfileHandle);
+    // An index opened with FH_MAPPED can only be scanned, and scans read its pages without copying them.
+    RC openFile(const string &fileName, IXFileHandle &ixfileHandle, FileMode mode = FH_READ_WRITE);
 
     // Close an ixfileHandle for an index.
     RC closeFile(IXFileHandle &ixfileHandle);
@@ -95,11 +103,21 @@ class IndexManager {
             page_pointer_t pnum;
         };
 
+        //Key that refers to bytes in a page or in the caller's buffer instead of owning a copy
+        struct key_view {
+            float r;
+            signed i;
+            const char *s;  //Varchar characters, not null terminated
+            unsigned len;
+        };
+
         //Possible page keys
         struct key {
             float r;
             signed i;
             string s;
+
+            key_view view() const { return {r, i, s.data(), (unsigned)s.length()}; }
         };
 
         //Bitmasks for metadata
@@ -111,12 +129,12 @@ class IndexManager {
         IndexPage(FileHandle &file, page_pointer_t page_num);  //Read in page
         IndexPage(PageType type, void *initial_data, size_t data_size,
                   page_pointer_t next_ = NULL_PAGE, page_pointer_t prev_ = NULL_PAGE);
-        ~IndexPage() { delete data; };
+        ~IndexPage() { free(buffer); };
 
         //Iterator
         iterator begin(AttrType attr_type) const;
         iterator end(AttrType attr_type) const;
-        iterator find(AttrType attr_type, key &search_key) const;
+        iterator find(AttrType attr_type, const key_view &search_key) const;
         void insert(iterator &it, key &k, value &v);
         RC erase(iterator &it);
         IndexPage split(iterator &it);  //Split data after iterator into new page
@@ -124,20 +142,29 @@ class IndexManager {
         //Commit file to disk
         RC write(FileHandle &file, ssize_t page_num = -1) const;
 
+        //Keys are compared in place, without copying them out of the page
+        static key_view readKey(AttrType attr_type, const char *where);
+        static int compareKeys(AttrType attr_type, const key_view &key1, const key_view &key2);
+
         PageType getType() const { return (*metadata & type_mask) ? LeafPage : InternalPage; }
         uint32_t getOffset() const { return *metadata & offset_mask; }
         page_pointer_t getNextPage() const { return *next; }
         page_pointer_t getPrevPage() const { return *prev; }
 
-        RC setData(FileHandle &file, size_t page_num) { return file.readPage(page_num, data); };
+        RC setData(FileHandle &file, size_t page_num) { pointTo(buffer); return file.readPage(page_num, data); };
+        //Same as setData, but a page of a mapped file is used in place, so it must not be modified
+        RC viewData(FileHandle &file, size_t page_num);
+        const char *getData() const { return data; }
         void setNextPage(page_pointer_t n) { *next = n; }
         void setPrevPage(page_pointer_t p) { *prev = p; }
 
        private:
         void setupPointers();
+        void pointTo(char *page);
         void setOffset(uint32_t offset) { *metadata = (offset & offset_mask) | (*metadata & type_mask); }
 
-        char *data;
+        char *buffer;  //Copy of a page owned by this object
+        char *data;    //Page contents, either buffer or a page of a mapped file
         page_metadata_t *metadata;
 
         //Leaf pages only
@@ -149,6 +176,7 @@ class IndexManager {
        public:
         value getValue() const;
         key getKey() const;
+        key_view getKeyView() const { return IndexPage::readKey(attr_type, where); }
         size_t getOffset() const { return where - page; }
 
         bool operator==(const iterator &that) const { return this->where == that.where; }
@@ -183,11 +211,14 @@ class IndexManager {
     static IndexManager *_index_manager;
     static PagedFileManager *pfm;
     vector<page_pointer_t> search(AttrType attrType, void *key, IXFileHandle &ixfileHandle);
+    page_pointer_t searchLeaf(AttrType attrType, const IndexPage::key_view &k, IXFileHandle &ixfileHandle,
+                              IndexPage &page, vector<page_pointer_t> *path = NULL);
     IndexPage::key createKey(AttrType attrType, void *key);
+    IndexPage::key_view createKeyView(AttrType attrType, const void *key) const;
     ssize_t getRecordSize(IndexPage::key k, AttrType attrType, IndexPage::value v, PageType pageType);
     void printHelper(int numSpaces, IXFileHandle &ixfileHandle, AttrType attrType, page_pointer_t currPageNum) const;
-    bool areKeysEqual(AttrType attrType, IndexPage::key key1, IndexPage::key key2) const;
-    void printKey(AttrType attrType, IndexPage::key k) const;
+    bool areKeysEqual(AttrType attrType, const IndexPage::key_view &key1, const IndexPage::key_view &key2) const;
+    void printKey(AttrType attrType, const IndexPage::key_view &k) const;
 };
 
 class IX_ScanIterator {
@@ -201,6 +232,13 @@ class IX_ScanIterator {
     // Get next matching entry
     RC getNextEntry(RID &rid, void *key);
 
+    // Start over with a new key range on the same open index. Internal pages read by the last
+    // search are reused as long as nothing has been written through this file handle since.
+    RC reset(const void *lowKey_,
+             const void *highKey_,
+             bool lowKeyInclusive_,
+             bool highKeyInclusive_);
+
     // Terminate index scan
     RC close();
 
@@ -211,23 +249,106 @@ class IX_ScanIterator {
     AttrType attrType;
     const void *lowKey;
     const void *highKey;
+    IndexManager::IndexPage::key_view highKeyView;  //Parsed once by scanInit
     bool lowKeyInclusive;
     bool highKeyInclusive;
     IndexManager::IndexPage temp;
     page_pointer_t startPage;
     page_pointer_t endPage;
     IndexManager::IndexPage::iterator start;
+
+    //Internal pages of the last search from the root, one per level
+    vector<IndexManager::IndexPage *> path;
+    vector<page_pointer_t> pathPages;
+    size_t internalLevels;  //Levels above the leaves, NO_LEVELS until a search reaches a leaf
+    unsigned pathVersion;   //Version of the file when path was read
+
+    static const size_t NO_LEVELS = (size_t)-1;
+
     page_pointer_t getLeftPage();
     page_pointer_t getRightPage();
+    page_pointer_t searchLeaf(const IndexManager::IndexPage::key_view &k);
     RC scanInit(IXFileHandle &ixfileHandle_,
                 const AttrType &attrType_,
                 const void *lowKey_,
                 const void *highKey_,
                 bool lowKeyInclusive_,
                 bool highKeyInclusive_);
-    void formatKey(IndexManager::IndexPage::key k, void *dest);
-    bool keyCmpLess(IndexManager::IndexPage::key key1, IndexManager::IndexPage::key key2);
-    bool keyCmpLessEqual(IndexManager::IndexPage::key key1, IndexManager::IndexPage::key key2);
+    void formatKey(const IndexManager::IndexPage::key_view &k, void *dest);
+};
+
+// IX_BulkLoader builds a new index bottom up instead of inserting entries one at a time.
+// Entries can be added in any order. They are sorted, spilling sorted runs to temporary files
+// when they don't fit in IX_BULK_BUFFER_SIZE, then packed into leaves left to right and the
+// internal levels are built on top of them. Pages are written sequentially.
+// The index must be empty, i.e. just created with IndexManager::createFile().
+//  IX_BulkLoader loader(ixfileHandle, attribute);
+//  for each entry: loader.addEntry(key, rid);
+//  loader.finish();
+class IX_BulkLoader {
+   public:
+    IX_BulkLoader(IXFileHandle &ixfileHandle, const Attribute &attribute, float fillFactor = IX_DEFAULT_FILL_FACTOR);
+    ~IX_BulkLoader();
+
+    // Key is in the same format as for IndexManager::insertEntry()
+    RC addEntry(const void *key, const RID &rid);
+
+    // Write the index. No entries can be added afterwards
+    RC finish();
+
+   private:
+    typedef IndexManager::IndexPage::key_view key_view;
+
+    //Sorted run on disk, read back one page at a time during the merge
+    struct Run {
+        string fileName;
+        FileHandle fileHandle;
+        PageNum pageNum;
+        char page[PAGE_SIZE];
+        size_t offset;
+    };
+
+    //Compares run entries by key, then RID
+    struct RunGreater {
+        IX_BulkLoader *loader;
+        bool operator()(const Run *a, const Run *b) const;
+    };
+
+    IXFileHandle *ix;
+    AttrType attrType;
+    size_t pageLimit;  //Bytes of a page filled before moving on to the next one
+
+    //Entries not yet written to a run, each a key followed by its RID
+    vector<char> buffer;
+    vector<size_t> entries;
+    vector<Run *> runs;
+    static unsigned runCounter;
+
+    //Leaf being filled
+    char leaf[PAGE_SIZE];
+    size_t leafSize;
+    size_t lastEntry;
+    page_pointer_t leafPage;
+
+    //First key and page number of every page of the level being built
+    vector<pair<string, page_pointer_t> > children;
+
+    //Consecutive pages waiting to be written, starting at pendingPage
+    vector<char> pending;
+    page_pointer_t pendingPage;
+
+    size_t getKeySize(const char *entry) const;
+    int compareEntries(const char *entry1, const char *entry2) const;
+    void sortEntries();
+    RC writeRun();
+    RC advanceRun(Run *run, bool &hasEntry);
+    RC mergeRuns();
+    RC addToLeaf(const char *entry);
+    RC writeLeaf(page_pointer_t next);
+    RC writePage(page_pointer_t pageNum, const IndexManager::IndexPage &page);
+    RC writePending();
+    RC buildInternalLevels();
+    void removeRuns();
 };
 
 #endif
@@ -7,79 +7,87 @@
 
 //Compare two values with given operation
 bool Value::compare(CompOp op, const Value& other) const {
-    if (type != other.type) return false;
+    return compare(Predicate(type, op), other);
+}
+
+//Compare two values with an operation chosen ahead of time
+bool Value::compare(const Predicate& predicate, const Value& other) const {
+    if (type != other.type || type != predicate.getType()) return false;
 
     //Null values can only be compared for equality
     if (data == NULL || other.data == NULL) {
-        return (data == NULL && other.data == NULL && op == EQ_OP);
+        return (data == NULL && other.data == NULL && predicate.getOp() == EQ_OP);
+    }
+
+    return predicate(data, other.data);
+}
+
+//Get total size of value
+size_t Value::getSize() const {
+    switch (type) {
+        case TypeReal:
+            return REAL_SIZE;
+        case TypeInt:
+            return INT_SIZE;
+        case TypeVarChar:
+            unsigned len;
+            memcpy(&len, data, VARCHAR_LENGTH_SIZE);
+            return len + VARCHAR_LENGTH_SIZE;
+        default:
+            return 0;
     }
+}
+
+//Order two values of the same type
+int Value::compareTo(const Value& other) const {
+    if (data == NULL || other.data == NULL) return (data != NULL) - (other.data != NULL);
 
     switch (type) {
         case AttrType::TypeInt: {
             signed lhs, rhs;
             memcpy(&lhs, data, INT_SIZE);
             memcpy(&rhs, other.data, INT_SIZE);
-            auto comp = getOperator<signed>(op);
-            return comp(lhs, rhs);
+            return (lhs > rhs) - (lhs < rhs);
         }
         case AttrType::TypeReal: {
             float lhs, rhs;
             memcpy(&lhs, data, REAL_SIZE);
             memcpy(&rhs, other.data, REAL_SIZE);
-            auto comp = getOperator<float>(op);
-            return comp(lhs, rhs);
+            return (lhs > rhs) - (lhs < rhs);
         }
         case AttrType::TypeVarChar: {
-            unsigned rhs_len, lhs_len;
-            char *rhs, *lhs;
-            memcpy(&rhs_len, data, VARCHAR_LENGTH_SIZE);
-            memcpy(&lhs_len, other.data, VARCHAR_LENGTH_SIZE);
-            rhs = static_cast<char*>(data) + VARCHAR_LENGTH_SIZE;
-            lhs = static_cast<char*>(other.data) + VARCHAR_LENGTH_SIZE;
-            auto comp = getOperator<string>(op);
-            return comp({rhs, rhs_len}, {lhs, lhs_len});
+            unsigned lhs_len, rhs_len;
+            memcpy(&lhs_len, data, VARCHAR_LENGTH_SIZE);
+            memcpy(&rhs_len, other.data, VARCHAR_LENGTH_SIZE);
+            int cmp = memcmp(static_cast<char*>(data) + VARCHAR_LENGTH_SIZE, static_cast<char*>(other.data) + VARCHAR_LENGTH_SIZE,
+                             min(lhs_len, rhs_len));
+            if (cmp != 0) return cmp;
+            return (lhs_len > rhs_len) - (lhs_len < rhs_len);
         }
         default:
-            return false;
+            return 0;
     }
 }
 
-//Get functor for operation type
-template <typename t>
-function<bool(t, t)> Value::getOperator(CompOp op) const {
-    switch (op) {
-        case EQ_OP:
-            return [](t lhs, t rhs) { return lhs == rhs; };
-        case LT_OP:
-            return [](t lhs, t rhs) { return lhs < rhs; };
-        case LE_OP:
-            return [](t lhs, t rhs) { return lhs <= rhs; };
-        case GT_OP:
-            return [](t lhs, t rhs) { return lhs > rhs; };
-        case GE_OP:
-            return [](t lhs, t rhs) { return lhs >= rhs; };
-        case NE_OP:
-            return [](t lhs, t rhs) { return lhs != rhs; };
-        case NO_OP:
-        default:
-            return [](t lhs, t rhs) { return true; };
+//FNV-1a over the value's bytes
+uint32_t Value::hash() const {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t size = getSize();
+
+    //0.0 and -0.0 are equal
+    float zero = 0;
+    if (type == TypeReal) {
+        float r;
+        memcpy(&r, data, REAL_SIZE);
+        if (r == 0) bytes = reinterpret_cast<const unsigned char*>(&zero);
     }
-}
 
-//Get total size of value
-size_t Value::getSize() const {
-    switch (type) {
-        case TypeReal:
-            return REAL_SIZE;
-        case TypeInt:
-            return INT_SIZE;
-        case TypeVarChar:
-            unsigned len;
-            memcpy(&len, data, VARCHAR_LENGTH_SIZE);
-            return len + VARCHAR_LENGTH_SIZE;
-        default:
-            return 0;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
     }
+    return hash;
 }
 
 // Tuple =====================================================================
@@ -114,9 +122,48 @@ Value Tuple::getValue(const string& attr_name) const {
     return Value{.data = NULL};
 }
 
+//Get attribute at a position
+Value Tuple::getValue(int index) const {
+    if (index < 0) return Value{.data = NULL};
+    if (offsets[index] == NULL_OFFSET) return {attrs[index].type, NULL};
+    return {attrs[index].type, data + offsets[index]};
+}
+
+void Tuple::parse() {
+    offsets.resize(attrs.size());
+    uint32_t offset = static_cast<uint32_t>(ceil(attrs.size() / double(CHAR_BIT)));
+
+    for (size_t i = 0; i < attrs.size(); i++) {
+        if (isNull(i)) {
+            offsets[i] = NULL_OFFSET;
+            continue;
+        }
+        offsets[i] = offset;
+        offset += Value{attrs[i].type, data + offset}.getSize();
+    }
+}
+
+int Tuple::getIndex(const vector<Attribute>& attrs, const string& attr_name) {
+    for (size_t i = 0; i < attrs.size(); i++) {
+        if (attrs[i].name == attr_name) return i;
+    }
+    return -1;
+}
+
+//Get size of tuple
+size_t Tuple::getSize() const {
+    char* curr_data = data + static_cast<size_t>(ceil(attrs.size() / double(CHAR_BIT)));
+
+    for (size_t i = 0; i < attrs.size(); i++) {
+        if (isNull(i)) continue;
+        curr_data += Value{attrs[i].type, curr_data}.getSize();
+    }
+    return curr_data - data;
+}
+
 // Tuple::Builder ============================================================
 
-Tuple::Builder::Builder(char* data_, size_t num_attrs_) : num_attrs(num_attrs_), data(data_) {
+Tuple::Builder::Builder(char* data_, size_t num_attrs_) : num_attrs(num_attrs_), num_appended(0), data(data_) {
     data_end = data + static_cast<size_t>(ceil(num_attrs / double(CHAR_BIT)));
     memset(data, 0, ceil(num_attrs / double(CHAR_BIT)));
 }
@@ -128,14 +175,18 @@ Tuple Tuple::Builder::getTuple() const {
 
 //Append a given value to the builder
 void Tuple::Builder::appendValue(const Value& v, const string& attr_name) {
-    if (num_attrs == attrs.size()) return;
+    if (num_appended == num_attrs) return;
 
-    size_t index = attrs.size();
     attrs.push_back({attr_name, v.type});
+    appendValue(v);
+}
+
+void Tuple::Builder::appendValue(const Value& v) {
+    if (num_appended == num_attrs) return;
+    size_t index = num_appended++;
 
     //Set null bit
-    char null_bit = (v.data == NULL) ? 0x8 : 0x0;
-    *(data + (index / CHAR_BIT)) = *(data + (index / CHAR_BIT)) | null_bit >> (index % CHAR_BIT);
+    if (v.data == NULL) data[index / CHAR_BIT] |= 0x80 >> (index % CHAR_BIT);
 
     //Copy data
     if (v.data != NULL) {
@@ -144,13 +195,120 @@ void Tuple::Builder::appendValue(const Value& v, const string& attr_name) {
     }
 }
 
+void Tuple::Builder::appendValues(const Tuple& tuple) {
+    for (size_t i = 0; i < tuple.attrs.size(); i++) appendValue(tuple.getValue(i));
+}
+
+// Iterator ==================================================================
+
+//Fill the batch one tuple at a time for iterators without their own batches
+RC Iterator::getNextBatch(TupleBatch& batch) {
+    vector<Attribute> attrs;
+    getAttributes(attrs);
+    batch.reset(attrs);
+
+    while (!batch.full() && getNextTuple(batch.nextTuple()) == SUCCESS) batch.commitTuple();
+    return (batch.size() > 0) ? SUCCESS : QE_EOF;
+}
+
+// TupleBatch ================================================================
+
+const uint32_t TupleBatch::NULL_COLUMN;
+const uint32_t Tuple::NULL_OFFSET;
+
+void TupleBatch::reset(const vector<Attribute>& attrs_) {
+    attrs = attrs_;
+    used = 0;
+    tuple_offsets.clear();
+    column_offsets.clear();
+}
+
+char* TupleBatch::nextTuple() {
+    if (data.size() < used + PAGE_SIZE) data.resize(used + PAGE_SIZE);
+    return &data[used];
+}
+
+//Add the tuple written to nextTuple(), finding where each of its attributes starts
+void TupleBatch::commitTuple() {
+    const char* tuple = &data[used];
+    size_t offset = static_cast<size_t>(ceil(attrs.size() / double(CHAR_BIT)));
+
+    for (size_t i = 0; i < attrs.size(); i++) {
+        if (Tuple::isNull(tuple, i)) {
+            column_offsets.push_back(NULL_COLUMN);
+            continue;
+        }
+        column_offsets.push_back(offset);
+        offset += Value{attrs[i].type, const_cast<char*>(tuple + offset)}.getSize();
+    }
+
+    tuple_offsets.push_back(used);
+    used += offset;
+}
+
+void TupleBatch::addTuple(const TupleBatch& other, size_t i) {
+    size_t size = other.getTupleSize(i);
+    memcpy(nextTuple(), other.getTuple(i), size);
+
+    tuple_offsets.push_back(used);
+    used += size;
+    size_t first = i * other.attrs.size();
+    column_offsets.insert(column_offsets.end(), other.column_offsets.begin() + first,
+                          other.column_offsets.begin() + first + other.attrs.size());
+}
+
+size_t TupleBatch::getTupleSize(size_t i) const {
+    size_t end = (i + 1 < tuple_offsets.size()) ? tuple_offsets[i + 1] : used;
+    return end - tuple_offsets[i];
+}
+
+Value TupleBatch::getValue(size_t i, size_t column) const {
+    uint32_t offset = column_offsets[i * attrs.size() + column];
+    if (offset == NULL_COLUMN) return {attrs[column].type, NULL};
+    return {attrs[column].type, const_cast<char*>(&data[tuple_offsets[i] + offset])};
+}
+
+int TupleBatch::getColumn(const string& attr_name) const {
+    for (size_t i = 0; i < attrs.size(); i++) {
+        if (attrs[i].name == attr_name) return i;
+    }
+    return -1;
+}
+
+// BatchReader ===============================================================
+
+RC BatchReader::getNextTuple(void* data) {
+    if (pos >= batch.size()) {
+        pos = 0;
+        if (input->getNextBatch(batch) != SUCCESS) return QE_EOF;
+    }
+
+    memcpy(data, batch.getTuple(pos), batch.getTupleSize(pos));
+    pos++;
+    return SUCCESS;
+}
+
 // Filter ====================================================================
 
 Filter::Filter(Iterator* input_, const Condition& condition_) : input(input_), condition(condition_) {
     input->getAttributes(attrs);
+    tuple = Tuple(NULL, attrs);
+    lhs_index = Tuple::getIndex(attrs, condition.lhsAttr);
+    predicate = Predicate(condition.rhsValue.type, condition.op);
+
+    //Let the scan below skip the tuples that don't match when it can
+    pushed = false;
+    if (!condition.bRhsIsAttr) {
+        if (TableScan* scan = dynamic_cast<TableScan*>(input)) {
+            pushed = scan->pushCondition(condition.lhsAttr, condition.op, condition.rhsValue);
+        } else if (IndexScan* scan = dynamic_cast<IndexScan*>(input)) {
+            scan->pushCondition(condition.lhsAttr, condition.op, condition.rhsValue);
+        }
+    }
 }
 
 RC Filter::getNextTuple(void* data) {
+    if (pushed) return input->getNextTuple(data);
     do {
         if (input->getNextTuple(data) != SUCCESS) return QE_EOF;
     } while (!isFilteredTuple(data));
@@ -160,11 +318,27 @@ RC Filter::getNextTuple(void* data) {
 
 //Check if tuple is included in filter
 bool Filter::isFilteredTuple(void* data) {
-    Tuple t(static_cast<char*>(data), attrs);
-    Value v = t.getValue(condition.lhsAttr);
+    tuple.data = static_cast<char*>(data);
+    tuple.parse();
+    Value v = tuple.getValue(lhs_index);
 
     // condition.bRhsIsAttr assumed to be false
-    return v.compare(condition.op, condition.rhsValue);
+    return v.compare(predicate, condition.rhsValue);
+}
+
+//Keep the matching tuples of input batches until at least one matches
+RC Filter::getNextBatch(TupleBatch& batch) {
+    if (pushed) return input->getNextBatch(batch);
+    batch.reset(attrs);
+    while (batch.size() == 0) {
+        if (input->getNextBatch(input_batch) != SUCCESS) return QE_EOF;
+
+        for (size_t i = 0; i < input_batch.size(); i++) {
+            Value v = (lhs_index < 0) ? Value{.data = NULL} : input_batch.getValue(i, lhs_index);
+            if (v.compare(predicate, condition.rhsValue)) batch.addTuple(input_batch, i);
+        }
+    }
+    return SUCCESS;
 }
 
 void Filter::getAttributes(vector<Attribute>& attrs_) const {
@@ -175,37 +349,63 @@ void Filter::getAttributes(vector<Attribute>& attrs_) const {
 // Project ===================================================================
 
 Project::Project(Iterator* input_, const vector<string>& attrNames) : input(input_), output_attrs(attrNames) {
+    //A TableScan below can read just the projected attributes out of each record
+    TableScan* scan = dynamic_cast<TableScan*>(input);
+    pushed = scan != NULL && scan->pushProjection(output_attrs);
+
     input->getAttributes(input_attrs);
     source = Tuple(buffer, input_attrs);
+
+    //Find the projected attributes once instead of for every tuple
+    for (const string& attr_name : output_attrs) {
+        indices.push_back(Tuple::getIndex(input_attrs, attr_name));
+        for (const Attribute& attr : input_attrs) {
+            if (attr_name == attr.name) attrs.emplace_back(attr);
+        }
+    }
 }
 
 RC Project::getNextTuple(void* data) {
+    if (pushed) return input->getNextTuple(data);
     if (input->getNextTuple(buffer) != SUCCESS) return QE_EOF;
+    source.parse();
 
     //Build new tuple with projected attributes
-    Tuple::Builder projection = Tuple::build(static_cast<char*>(data), output_attrs.size());
-    for (const string& attr : output_attrs) projection.appendValue(source.getValue(attr), attr);
+    Tuple::Builder projection = Tuple::build(static_cast<char*>(data), indices.size());
+    for (int index : indices) projection.appendValue(source.getValue(index));
     return SUCCESS;
 }
 
-void Project::getAttributes(vector<Attribute>& attrs) const {
-    attrs.clear();
-    for (const string& attr_name : output_attrs) {
-        for (const Attribute& attr : input_attrs) {
-            if (attr_name == attr.name) attrs.emplace_back(attr);
+RC Project::getNextBatch(TupleBatch& batch) {
+    if (pushed) return input->getNextBatch(batch);
+    batch.reset(attrs);
+    if (input->getNextBatch(input_batch) != SUCCESS) return QE_EOF;
+
+    for (size_t i = 0; i < input_batch.size(); i++) {
+        Tuple::Builder projection = Tuple::build(batch.nextTuple(), indices.size());
+        for (int index : indices) {
+            projection.appendValue((index < 0) ? Value{.data = NULL} : input_batch.getValue(i, index));
         }
+        batch.commitTuple();
     }
+    return SUCCESS;
+}
+
+void Project::getAttributes(vector<Attribute>& attrs_) const {
+    attrs_.clear();
+    attrs_.insert(attrs_.end(), attrs.begin(), attrs.end());
 };
 
 // INLJoin ===================================================================
 
 INLJoin::INLJoin(Iterator* leftIn_, IndexScan* rightIn_, const Condition& condition_)
-    : leftIn(leftIn_), rightIn(rightIn_), condition(condition_) {
+    : leftIn(leftIn_), rightIn(rightIn_), condition(condition_), left_reader(leftIn_) {
     leftIn->getAttributes(left_attrs);
     rightIn->getAttributes(right_attrs);
 
     left_tuple = Tuple(NULL);  //Left tuple is initially null
     right_tuple = Tuple(right_buffer, right_attrs);
+    lhs_index = Tuple::getIndex(left_attrs, condition.lhsAttr);
 }
 
 RC INLJoin::getNextTuple(void* data) {
@@ -219,19 +419,24 @@ RC INLJoin::getNextTuple(void* data) {
     while (rightIn->getNextTuple(right_buffer) != SUCCESS) {
         if (getNextOuterTuple() != SUCCESS) return QE_EOF;
     }
+    right_tuple.parse();
 
     //Build result tuple
     Tuple::Builder result = Tuple::build(static_cast<char*>(data), left_attrs.size() + right_attrs.size());
-    for (const Attribute& attr : left_attrs) result.appendValue(left_tuple.getValue(attr.name), attr.name);
-    for (const Attribute& attr : right_attrs) result.appendValue(right_tuple.getValue(attr.name), attr.name);
+    result.appendValues(left_tuple);
+    result.appendValues(right_tuple);
 
     return SUCCESS;
 }
 
 //Get next tuple from outer (left) input
 RC INLJoin::getNextOuterTuple() {
-    if (leftIn->getNextTuple(left_buffer) != SUCCESS) return QE_EOF;
-    Value lhs = left_tuple.getValue(condition.lhsAttr);
+    //NULL never joins
+    do {
+        if (left_reader.getNextTuple(left_buffer) != SUCCESS) return QE_EOF;
+        left_tuple.parse();
+        lhs = left_tuple.getValue(lhs_index);
+    } while (lhs.data == NULL);
 
     //Only handling EQ_OP
     rightIn->setIterator(lhs.data, lhs.data, true, true);
@@ -244,4 +449,868 @@ void INLJoin::getAttributes(vector<Attribute>& attrs) const {
     //Output attrs is concatenation of inputs
     attrs.insert(attrs.end(), left_attrs.begin(), left_attrs.end());
     attrs.insert(attrs.end(), right_attrs.begin(), right_attrs.end());
-}
\ No newline at end of file
+}
+// Aggregate =================================================================
+
+const size_t Aggregate::NULL_GROUP;
+
+Aggregate::Aggregate(Iterator* input_, Attribute aggAttr_, AggregateOp op_)
+    : input(input_), aggAttr(aggAttr_), op(op_), grouped(false), reader(input_), null_group(NULL_GROUP), consumed(false), next_group(0) {
+    input->getAttributes(input_attrs);
+    source = Tuple(buffer, input_attrs);
+    agg_index = Tuple::getIndex(input_attrs, aggAttr.name);
+    group_index = -1;
+
+    //Scalar aggregation is a single group
+    accumulators.push_back({0, 0, 0, 0});
+}
+
+Aggregate::Aggregate(Iterator* input_, Attribute aggAttr_, Attribute groupAttr_, AggregateOp op_)
+    : input(input_), aggAttr(aggAttr_), groupAttr(groupAttr_), op(op_), grouped(true), reader(input_), null_group(NULL_GROUP), consumed(false), next_group(0) {
+    input->getAttributes(input_attrs);
+    source = Tuple(buffer, input_attrs);
+    agg_index = Tuple::getIndex(input_attrs, aggAttr.name);
+    group_index = Tuple::getIndex(input_attrs, groupAttr.name);
+    slots.assign(QE_AGG_INITIAL_SLOTS, Slot{0, 0});
+}
+
+RC Aggregate::getNextTuple(void* data) {
+    //Every group has to be seen before anything can be output
+    if (!consumed) {
+        if (consumeInput() != SUCCESS) return QE_EOF;
+        consumed = true;
+    }
+    if (next_group >= accumulators.size()) return QE_EOF;
+
+    size_t group = next_group++;
+    float result;
+    Value agg_value = {TypeReal, getResult(accumulators[group], result) ? &result : NULL};
+
+    Tuple::Builder output = Tuple::build(static_cast<char*>(data), grouped ? 2 : 1);
+    if (grouped) {
+        size_t offset = group_offsets[group];
+        void* group_data = (offset == NULL_GROUP) ? NULL : &group_values[offset];
+        output.appendValue(Value{groupAttr.type, group_data});
+    }
+    output.appendValue(agg_value);
+    return SUCCESS;
+}
+
+void Aggregate::getAttributes(vector<Attribute>& attrs) const {
+    static const char* op_names[] = {"MIN", "MAX", "COUNT", "SUM", "AVG"};
+
+    attrs.clear();
+    if (grouped) attrs.push_back(groupAttr);
+    attrs.push_back({string(op_names[op]) + "(" + aggAttr.name + ")", TypeReal, REAL_SIZE});
+}
+
+//Read the whole input once, adding every tuple to its group
+RC Aggregate::consumeInput() {
+    while (reader.getNextTuple(buffer) == SUCCESS) {
+        source.parse();
+        size_t group = grouped ? findGroup(source.getValue(group_index)) : 0;
+        accumulate(accumulators[group], source.getValue(agg_index));
+    }
+    return SUCCESS;
+}
+
+//Get the group of a value, adding a new group if it hasn't been seen
+size_t Aggregate::findGroup(const Value& v) {
+    if (v.data == NULL) {
+        if (null_group == NULL_GROUP) null_group = addGroup(v, 0);
+        return null_group;
+    }
+
+    uint32_t hash = v.hash();
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (slot.group == 0) {
+            size_t group = addGroup(v, hash);
+            slot.hash = hash;
+            slot.group = group + 1;
+
+            //Keep the table at most 3/4 full
+            if (accumulators.size() * 4 > slots.size() * 3) growTable();
+            return group;
+        }
+        if (slot.hash != hash) continue;
+
+        Value group_value = {v.type, &group_values[group_offsets[slot.group - 1]]};
+        if (v.type == TypeReal) {
+            float lhs, rhs;
+            memcpy(&lhs, v.data, REAL_SIZE);
+            memcpy(&rhs, group_value.data, REAL_SIZE);
+            if (lhs == rhs) return slot.group - 1;
+        } else if (memcmp(v.data, group_value.data, v.getSize()) == 0) {
+            return slot.group - 1;
+        }
+    }
+}
+
+size_t Aggregate::addGroup(const Value& v, uint32_t hash) {
+    if (v.data == NULL) {
+        group_offsets.push_back(NULL_GROUP);
+    } else {
+        const char* value = static_cast<const char*>(v.data);
+        group_offsets.push_back(group_values.size());
+        group_values.insert(group_values.end(), value, value + v.getSize());
+    }
+    accumulators.push_back({0, 0, 0, 0});
+    return accumulators.size() - 1;
+}
+
+//Double the table, reinserting every group by its saved hash
+void Aggregate::growTable() {
+    vector<Slot> old_slots(slots.size() * 2, Slot{0, 0});
+    old_slots.swap(slots);
+
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : old_slots) {
+        if (slot.group == 0) continue;
+        size_t i = slot.hash & mask;
+        while (slots[i].group != 0) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
+
+void Aggregate::accumulate(Accumulator& acc, const Value& v) {
+    if (v.data == NULL) return;
+
+    float value;
+    if (v.type == TypeInt) {
+        signed i;
+        memcpy(&i, v.data, INT_SIZE);
+        value = i;
+    } else if (v.type == TypeReal) {
+        memcpy(&value, v.data, REAL_SIZE);
+    } else {
+        value = 0;  //Only COUNT makes sense for varchar
+    }
+
+    if (acc.count == 0 || value < acc.min) acc.min = value;
+    if (acc.count == 0 || value > acc.max) acc.max = value;
+    acc.sum += value;
+    acc.count++;
+}
+
+//Final value of a group, false if it is NULL
+bool Aggregate::getResult(const Accumulator& acc, float& result) const {
+    if (op == COUNT) {
+        result = acc.count;
+        return true;
+    }
+    if (acc.count == 0) return false;
+
+    switch (op) {
+        case MIN:
+            result = acc.min;
+            break;
+        case MAX:
+            result = acc.max;
+            break;
+        case SUM:
+            result = acc.sum;
+            break;
+        case AVG:
+            result = acc.sum / acc.count;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// GHJoin ====================================================================
+
+unsigned GHJoin::joinCounter = 0;
+const size_t GHJoin::NO_MATCH;
+
+GHJoin::GHJoin(Iterator* leftIn_, Iterator* rightIn_, const Condition& condition_, const unsigned numPartitions_)
+    : leftIn(leftIn_), rightIn(rightIn_), condition(condition_), numPartitions(max(numPartitions_, 1u)),
+      left_reader(leftIn_), right_reader(rightIn_), match(NO_MATCH), started(false), partitioned(false), partition(0), partition_open(false) {
+    leftIn->getAttributes(left_attrs);
+    rightIn->getAttributes(right_attrs);
+
+    left_tuple = Tuple(NULL, left_attrs);  //Points into the hash table
+    right_tuple = Tuple(right_buffer, right_attrs);
+    lhs_index = Tuple::getIndex(left_attrs, condition.lhsAttr);
+    rhs_index = Tuple::getIndex(right_attrs, condition.rhsAttr);
+    if (lhs_index >= 0) equal = Predicate(left_attrs[lhs_index].type, EQ_OP);
+}
+
+GHJoin::~GHJoin() {
+    closePartition();
+
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    for (const string& fileName : left_partitions) rbfm->destroyFile(fileName);
+    for (const string& fileName : right_partitions) rbfm->destroyFile(fileName);
+}
+
+RC GHJoin::getNextTuple(void* data) {
+    //getNextTuple is being called for the first time
+    if (!started) {
+        started = true;
+        if (build() != SUCCESS) return QE_EOF;
+    }
+
+    while (true) {
+        //Walk the chain of the right tuple's bucket
+        while (match != NO_MATCH) {
+            size_t m = match;
+            match = build_next[m];
+            if (build_hashes[m] != rhs_hash) continue;
+
+            left_tuple.data = &build_tuples[build_offsets[m]];
+            left_tuple.parse();
+            if (!left_tuple.getValue(lhs_index).compare(equal, rhs)) continue;
+
+            //Build result tuple
+            Tuple::Builder result = Tuple::build(static_cast<char*>(data), left_attrs.size() + right_attrs.size());
+            result.appendValues(left_tuple);
+            result.appendValues(right_tuple);
+            return SUCCESS;
+        }
+
+        if (getNextRightTuple() != SUCCESS) return QE_EOF;
+    }
+}
+
+void GHJoin::getAttributes(vector<Attribute>& attrs) const {
+    attrs.clear();
+
+    //Output attrs is concatenation of inputs
+    attrs.insert(attrs.end(), left_attrs.begin(), left_attrs.end());
+    attrs.insert(attrs.end(), right_attrs.begin(), right_attrs.end());
+}
+
+//Hash the left input in memory, or partition both inputs if it is too big
+RC GHJoin::build() {
+    Tuple tuple(left_buffer, left_attrs);
+    bool more;
+    while ((more = (left_reader.getNextTuple(left_buffer) == SUCCESS))) {
+        tuple.parse();
+        Value v = tuple.getValue(lhs_index);
+        if (v.data == NULL) continue;  //NULL never joins
+
+        size_t size = tuple.getSize();
+        if (build_tuples.size() + size > QE_GHJ_MEMORY_SIZE) break;
+        addBuildTuple(left_buffer, size, v.hash());
+    }
+
+    if (!more) {
+        buildTable();
+        return SUCCESS;
+    }
+
+    //Left input doesn't fit, so partition both inputs
+    partitioned = true;
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    if (createPartitions() != SUCCESS) return QE_EOF;
+
+    //Tuples that were already read, then the one that didn't fit and the rest of the input
+    vector<FileHandle> handles(numPartitions);
+    for (unsigned p = 0; p < numPartitions; p++) {
+        if (rbfm->openFile(left_partitions[p], handles[p]) != SUCCESS) return QE_EOF;
+    }
+    for (size_t i = 0; i < build_offsets.size(); i++) {
+        if (writePartition(handles[build_hashes[i] % numPartitions], left_attrs, &build_tuples[build_offsets[i]]) != SUCCESS) return QE_EOF;
+    }
+    do {
+        tuple.parse();
+        Value v = tuple.getValue(lhs_index);
+        if (v.data == NULL) continue;
+        if (writePartition(handles[v.hash() % numPartitions], left_attrs, left_buffer) != SUCCESS) return QE_EOF;
+    } while (left_reader.getNextTuple(left_buffer) == SUCCESS);
+    for (unsigned p = 0; p < numPartitions; p++) rbfm->closeFile(handles[p]);
+
+    if (partitionRight() != SUCCESS) return QE_EOF;
+    return openPartition(0);
+}
+
+void GHJoin::addBuildTuple(const char* tuple, size_t size, uint32_t hash) {
+    build_offsets.push_back(build_tuples.size());
+    build_tuples.insert(build_tuples.end(), tuple, tuple + size);
+    build_hashes.push_back(hash);
+}
+
+//Chain the left tuples into buckets, keeping their input order within a bucket
+void GHJoin::buildTable() {
+    size_t num_buckets = 1;
+    while (num_buckets < build_offsets.size()) num_buckets <<= 1;
+
+    buckets.assign(num_buckets, NO_MATCH);
+    build_next.assign(build_offsets.size(), NO_MATCH);
+    for (size_t i = build_offsets.size(); i-- > 0;) {
+        size_t bucket = getBucket(build_hashes[i]);
+        build_next[i] = buckets[bucket];
+        buckets[bucket] = i;
+    }
+}
+
+RC GHJoin::createPartitions() {
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    string prefix = "ghjoin_" + to_string(joinCounter++) + "_";
+
+    for (unsigned p = 0; p < numPartitions; p++) {
+        left_partitions.push_back(prefix + "left_" + to_string(p));
+        right_partitions.push_back(prefix + "right_" + to_string(p));
+        if (rbfm->createFile(left_partitions.back()) != SUCCESS) return QE_EOF;
+        if (rbfm->createFile(right_partitions.back()) != SUCCESS) return QE_EOF;
+    }
+    return SUCCESS;
+}
+
+RC GHJoin::writePartition(FileHandle& fileHandle, const vector<Attribute>& attrs, const void* tuple) {
+    RID rid;
+    return RecordBasedFileManager::instance()->insertRecord(fileHandle, attrs, tuple, rid);
+}
+
+RC GHJoin::partitionRight() {
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    vector<FileHandle> handles(numPartitions);
+    for (unsigned p = 0; p < numPartitions; p++) {
+        if (rbfm->openFile(right_partitions[p], handles[p]) != SUCCESS) return QE_EOF;
+    }
+
+    while (right_reader.getNextTuple(right_buffer) == SUCCESS) {
+        right_tuple.parse();
+        Value v = right_tuple.getValue(rhs_index);
+        if (v.data == NULL) continue;
+        if (writePartition(handles[v.hash() % numPartitions], right_attrs, right_buffer) != SUCCESS) return QE_EOF;
+    }
+
+    for (unsigned p = 0; p < numPartitions; p++) rbfm->closeFile(handles[p]);
+    return SUCCESS;
+}
+
+//Hash the left side of a partition and start scanning its right side
+RC GHJoin::openPartition(unsigned p) {
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    build_tuples.clear();
+    build_offsets.clear();
+    build_hashes.clear();
+
+    vector<string> left_names;
+    for (const Attribute& attr : left_attrs) left_names.push_back(attr.name);
+
+    FileHandle fileHandle;
+    RBFM_ScanIterator scan;
+    if (rbfm->openFile(left_partitions[p], fileHandle) != SUCCESS) return QE_EOF;
+    if (rbfm->scan(fileHandle, left_attrs, "", NO_OP, NULL, left_names, scan) != SUCCESS) return QE_EOF;
+
+    Tuple tuple(left_buffer, left_attrs);
+    RID rid;
+    while (scan.getNextRecord(rid, left_buffer) == SUCCESS) {
+        tuple.parse();
+        addBuildTuple(left_buffer, tuple.getSize(), tuple.getValue(lhs_index).hash());
+    }
+    scan.close();
+    rbfm->closeFile(fileHandle);
+    buildTable();
+
+    vector<string> right_names;
+    for (const Attribute& attr : right_attrs) right_names.push_back(attr.name);
+    if (rbfm->openFile(right_partitions[p], partition_handle) != SUCCESS) return QE_EOF;
+    partition_open = true;
+    return rbfm->scan(partition_handle, right_attrs, "", NO_OP, NULL, right_names, partition_scan);
+}
+
+void GHJoin::closePartition() {
+    if (!partition_open) return;
+    partition_scan.close();
+    RecordBasedFileManager::instance()->closeFile(partition_handle);
+    partition_open = false;
+}
+
+//Get the next right tuple with a join value and find its bucket
+RC GHJoin::getNextRightTuple() {
+    while (true) {
+        if (!partitioned) {
+            if (build_offsets.empty() || right_reader.getNextTuple(right_buffer) != SUCCESS) return QE_EOF;
+        } else {
+            RID rid;
+            if (partition_scan.getNextRecord(rid, right_buffer) != SUCCESS) {
+                //Move on to the next pair of partitions
+                closePartition();
+                if (++partition >= numPartitions) return QE_EOF;
+                if (openPartition(partition) != SUCCESS) return QE_EOF;
+                continue;
+            }
+        }
+
+        right_tuple.parse();
+        rhs = right_tuple.getValue(rhs_index);
+        if (rhs.data == NULL) continue;
+
+        rhs_hash = rhs.hash();
+        match = buckets[getBucket(rhs_hash)];
+        return SUCCESS;
+    }
+}
+
+// BNLJoin ===================================================================
+
+BNLJoin::BNLJoin(Iterator* leftIn_, TableScan* rightIn_, const Condition& condition_, const unsigned numPages_)
+    : leftIn(leftIn_), rightIn(rightIn_), condition(condition_), numPages(max(numPages_, 1u)),
+      left_reader(leftIn_), block_pos(0), started(false), left_pending(false), left_done(false) {
+    leftIn->getAttributes(left_attrs);
+    rightIn->getAttributes(right_attrs);
+
+    left_tuple = Tuple(NULL, left_attrs);  //Points into the block
+    right_tuple = Tuple(right_buffer, right_attrs);
+    lhs_index = Tuple::getIndex(left_attrs, condition.lhsAttr);
+    rhs_index = condition.bRhsIsAttr ? Tuple::getIndex(right_attrs, condition.rhsAttr) : -1;
+    if (condition.bRhsIsAttr && lhs_index >= 0) {
+        predicate = Predicate(left_attrs[lhs_index].type, condition.op);
+    } else {
+        predicate = Predicate(condition.rhsValue.type, condition.op);
+    }
+    block_tuples.reserve(numPages * PAGE_SIZE + PAGE_SIZE);
+}
+
+RC BNLJoin::getNextTuple(void* data) {
+    //getNextTuple is being called for the first time
+    if (!started) {
+        started = true;
+        if (loadBlock() != SUCCESS) return QE_EOF;
+    }
+
+    while (true) {
+        //Check the rest of the block against the right tuple
+        while (block_pos < block_offsets.size()) {
+            size_t i = block_pos++;
+            if (condition.bRhsIsAttr && (rhs.data == NULL || !block_values[i].compare(predicate, rhs))) continue;
+
+            //Build result tuple
+            left_tuple.data = &block_tuples[block_offsets[i]];
+            left_tuple.parse();
+            Tuple::Builder result = Tuple::build(static_cast<char*>(data), left_attrs.size() + right_attrs.size());
+            result.appendValues(left_tuple);
+            result.appendValues(right_tuple);
+            return SUCCESS;
+        }
+
+        //Get next right tuple
+        if (rightIn->getNextTuple(right_buffer) == SUCCESS) {
+            right_tuple.parse();
+            if (condition.bRhsIsAttr) rhs = right_tuple.getValue(rhs_index);
+            block_pos = 0;
+            continue;
+        }
+
+        //Right input is done with this block, so start over with the next one
+        if (loadBlock() != SUCCESS) return QE_EOF;
+        rightIn->setIterator();
+    }
+}
+
+void BNLJoin::getAttributes(vector<Attribute>& attrs) const {
+    attrs.clear();
+
+    //Output attrs is concatenation of inputs
+    attrs.insert(attrs.end(), left_attrs.begin(), left_attrs.end());
+    attrs.insert(attrs.end(), right_attrs.begin(), right_attrs.end());
+}
+
+//Fill the block with up to numPages pages of left tuples that can match
+RC BNLJoin::loadBlock() {
+    block_tuples.clear();
+    block_offsets.clear();
+    block_values.clear();
+    block_pos = 0;
+
+    Tuple tuple(left_buffer, left_attrs);
+    while (!left_done) {
+        if (!left_pending && left_reader.getNextTuple(left_buffer) != SUCCESS) {
+            left_done = true;
+            break;
+        }
+        left_pending = false;
+
+        //NULL never joins, and a comparison with a constant is the same for every right tuple
+        tuple.parse();
+        Value v = tuple.getValue(lhs_index);
+        if (v.data == NULL) continue;
+        if (!condition.bRhsIsAttr && !v.compare(predicate, condition.rhsValue)) continue;
+
+        //Leave the tuple for the next block once this one is full
+        size_t size = tuple.getSize();
+        if (!block_offsets.empty() && block_tuples.size() + size > numPages * PAGE_SIZE) {
+            left_pending = true;
+            break;
+        }
+        block_offsets.push_back(block_tuples.size());
+        block_tuples.insert(block_tuples.end(), left_buffer, left_buffer + size);
+    }
+    if (block_offsets.empty()) return QE_EOF;
+
+    //Join values point into the block, so find them once it is filled
+    for (size_t offset : block_offsets) {
+        tuple.data = &block_tuples[offset];
+        tuple.parse();
+        block_values.push_back(tuple.getValue(lhs_index));
+    }
+    block_pos = block_offsets.size();
+    return SUCCESS;
+}
+
+// Sort ======================================================================
+
+unsigned Sort::sortCounter = 0;
+
+Sort::Sort(Iterator* input_, const vector<SortKey>& keys_, const unsigned numPages_)
+    : input(input_), keys(keys_), numPages(max(numPages_, 3u)), reader(input_), next_tuple(0), started(false), in_memory(true) {
+    input->getAttributes(attrs);
+    for (const SortKey& key : keys) key_indices.push_back(Tuple::getIndex(attrs, key.attrName));
+    run_tuples.reserve(numPages * PAGE_SIZE + PAGE_SIZE);
+}
+
+Sort::~Sort() {
+    closeReaders();
+
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    for (const string& fileName : run_files) rbfm->destroyFile(fileName);
+}
+
+RC Sort::getNextTuple(void* data) {
+    //getNextTuple is being called for the first time
+    if (!started) {
+        started = true;
+        if (createRuns() != SUCCESS) return QE_EOF;
+    }
+
+    //Everything fit in memory
+    if (in_memory) {
+        if (next_tuple >= run_order.size()) return QE_EOF;
+        size_t i = run_order[next_tuple++];
+        size_t end = (i + 1 < run_offsets.size()) ? run_offsets[i + 1] : run_tuples.size();
+        memcpy(data, &run_tuples[run_offsets[i]], end - run_offsets[i]);
+        return SUCCESS;
+    }
+
+    //Take the smallest tuple of the runs
+    RunReader* winner = readers[losers[0]];
+    if (winner->done) return QE_EOF;
+    memcpy(data, winner->tuple, winner->size);
+    if (advanceReader(losers[0]) != SUCCESS) return QE_EOF;
+    adjust(losers[0]);
+    return SUCCESS;
+}
+
+void Sort::getAttributes(vector<Attribute>& attrs_) const {
+    attrs_.clear();
+    attrs_.insert(attrs_.end(), attrs.begin(), attrs.end());
+}
+
+//Read the input into sorted runs, merging them until the rest can be merged while outputting
+RC Sort::createRuns() {
+    Tuple tuple(buffer, attrs);
+    while (reader.getNextTuple(buffer) == SUCCESS) {
+        size_t size = tuple.getSize();
+        if (!run_offsets.empty() && run_tuples.size() + size > numPages * PAGE_SIZE) {
+            if (writeRun() != SUCCESS) return QE_EOF;
+        }
+        run_offsets.push_back(run_tuples.size());
+        run_tuples.insert(run_tuples.end(), buffer, buffer + size);
+    }
+
+    if (run_files.empty()) {
+        sortRun();
+        return SUCCESS;
+    }
+    in_memory = false;
+    if (!run_offsets.empty() && writeRun() != SUCCESS) return QE_EOF;
+
+    //Each pass merges neighbouring runs so equal keys stay in input order
+    size_t fan_in = numPages - 1;
+    while (run_files.size() > fan_in) {
+        vector<string> merged;
+        for (size_t first = 0; first < run_files.size(); first += fan_in) {
+            string fileName;
+            if (mergeRuns(first, min(fan_in, run_files.size() - first), fileName) != SUCCESS) return QE_EOF;
+            merged.push_back(fileName);
+        }
+        run_files = merged;
+    }
+
+    //The readers now own the remaining runs
+    RC rc = openReaders(0, run_files.size());
+    run_files.clear();
+    return rc;
+}
+
+//Order the tuples of the run being built
+void Sort::sortRun() {
+    size_t num_keys = keys.size();
+    run_values.resize(run_offsets.size() * num_keys);
+    Tuple tuple(NULL, attrs);
+    for (size_t i = 0; i < run_offsets.size(); i++) {
+        tuple.data = &run_tuples[run_offsets[i]];
+        tuple.parse();
+        getKeyValues(tuple, run_values.data() + i * num_keys);
+    }
+
+    run_order.resize(run_offsets.size());
+    for (size_t i = 0; i < run_order.size(); i++) run_order[i] = i;
+    stable_sort(run_order.begin(), run_order.end(), [this, num_keys](size_t a, size_t b) {
+        return compareTuples(run_values.data() + a * num_keys, run_values.data() + b * num_keys) < 0;
+    });
+}
+
+RC Sort::writeRun() {
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    sortRun();
+
+    string fileName = "sort_run_" + to_string(sortCounter++);
+    FileHandle fileHandle;
+    if (rbfm->createFile(fileName) != SUCCESS) return QE_EOF;
+    run_files.push_back(fileName);
+    if (rbfm->openFile(fileName, fileHandle) != SUCCESS) return QE_EOF;
+
+    RC rc = appendRun(fileHandle);
+    rbfm->closeFile(fileHandle);
+    return rc;
+}
+
+//Write the tuples held in memory to the end of a run file in run_order, then forget them
+RC Sort::appendRun(FileHandle& fileHandle) {
+    vector<const void*> tuples;
+    for (size_t i : run_order) tuples.push_back(&run_tuples[run_offsets[i]]);
+
+    vector<RID> rids;
+    RC rc = RecordBasedFileManager::instance()->appendRecords(fileHandle, attrs, tuples, rids);
+
+    run_tuples.clear();
+    run_offsets.clear();
+    run_values.clear();
+    run_order.clear();
+    return rc;
+}
+
+//Merge count runs starting at first into a new run, removing the old ones
+RC Sort::mergeRuns(size_t first, size_t count, string& fileName) {
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    if (openReaders(first, count) != SUCCESS) return QE_EOF;
+
+    fileName = "sort_run_" + to_string(sortCounter++);
+    FileHandle fileHandle;
+    if (rbfm->createFile(fileName) != SUCCESS) return QE_EOF;
+    if (rbfm->openFile(fileName, fileHandle) != SUCCESS) return QE_EOF;
+
+    //Output is collected in memory and written a page at a time, so it and the pages of the readers fit in numPages
+    RC rc = SUCCESS;
+    while (rc == SUCCESS && !readers[losers[0]]->done) {
+        RunReader* winner = readers[losers[0]];
+        if (!run_offsets.empty() && run_tuples.size() + winner->size > PAGE_SIZE) {
+            rc = appendRun(fileHandle);
+        }
+        run_order.push_back(run_offsets.size());
+        run_offsets.push_back(run_tuples.size());
+        run_tuples.insert(run_tuples.end(), winner->tuple, winner->tuple + winner->size);
+
+        if (rc == SUCCESS) rc = advanceReader(losers[0]);
+        adjust(losers[0]);
+    }
+    if (rc == SUCCESS) rc = appendRun(fileHandle);
+
+    rbfm->closeFile(fileHandle);
+    closeReaders();
+    return rc;
+}
+
+//Start reading count runs starting at first, and build the loser tree over them
+RC Sort::openReaders(size_t first, size_t count) {
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    vector<string> names;
+    for (const Attribute& attr : attrs) names.push_back(attr.name);
+
+    for (size_t r = 0; r < count; r++) {
+        RunReader* reader = new RunReader;
+        readers.push_back(reader);
+        reader->fileName = run_files[first + r];
+        reader->source = Tuple(reader->tuple, attrs);
+        reader->values.resize(keys.size());
+        reader->done = false;
+
+        if (rbfm->openFile(reader->fileName, reader->fileHandle) != SUCCESS) return QE_EOF;
+        if (rbfm->scan(reader->fileHandle, attrs, "", NO_OP, NULL, names, reader->scan) != SUCCESS) return QE_EOF;
+        if (advanceReader(r) != SUCCESS) return QE_EOF;
+    }
+
+    //Every node starts out holding readers.size(), which is smaller than any run
+    losers.assign(count, count);
+    for (size_t r = count; r-- > 0;) adjust(r);
+    return SUCCESS;
+}
+
+//Close and remove the runs being read
+void Sort::closeReaders() {
+    RecordBasedFileManager* rbfm = RecordBasedFileManager::instance();
+    for (RunReader* reader : readers) {
+        reader->scan.close();
+        rbfm->closeFile(reader->fileHandle);
+        rbfm->destroyFile(reader->fileName);
+        delete reader;
+    }
+    readers.clear();
+    losers.clear();
+}
+
+RC Sort::advanceReader(size_t r) {
+    RunReader* reader = readers[r];
+    RID rid;
+    if (reader->scan.getNextRecord(rid, reader->tuple) != SUCCESS) {
+        reader->done = true;
+        return SUCCESS;
+    }
+
+    reader->source.parse();
+    reader->size = reader->source.getSize();
+    getKeyValues(reader->source, reader->values.data());
+    return SUCCESS;
+}
+
+//Does reader a lose to reader b? Finished readers lose to everything, ties go to the earlier run
+bool Sort::isGreater(size_t a, size_t b) const {
+    if (a == readers.size()) return false;
+    if (b == readers.size()) return true;
+    if (readers[a]->done || readers[b]->done) return readers[a]->done && (!readers[b]->done || a > b);
+
+    int cmp = compareTuples(readers[a]->values.data(), readers[b]->values.data());
+    return cmp > 0 || (cmp == 0 && a > b);
+}
+
+//Replay the matches of reader r up to the root after its tuple changed
+void Sort::adjust(size_t r) {
+    size_t winner = r;
+    for (size_t t = (r + readers.size()) / 2; t > 0; t /= 2) {
+        if (isGreater(winner, losers[t])) swap(winner, losers[t]);
+    }
+    losers[0] = winner;
+}
+
+int Sort::compareTuples(const Value* lhs, const Value* rhs) const {
+    for (size_t i = 0; i < keys.size(); i++) {
+        int cmp = lhs[i].compareTo(rhs[i]);
+        if (cmp != 0) return keys[i].ascending ? cmp : -cmp;
+    }
+    return 0;
+}
+
+//Tuple must already be parsed
+void Sort::getKeyValues(const Tuple& tuple, Value* values) const {
+    for (size_t i = 0; i < keys.size(); i++) values[i] = tuple.getValue(key_indices[i]);
+}
+
+// SMJoin ====================================================================
+
+SMJoin::SMJoin(Iterator* leftIn_, Iterator* rightIn_, const Condition& condition_)
+    : leftIn(leftIn_), rightIn(rightIn_), condition(condition_), left_reader(leftIn_), right_reader(rightIn_),
+      group_pos(0), in_group(false),
+      started(false), left_done(false), right_done(false) {
+    leftIn->getAttributes(left_attrs);
+    rightIn->getAttributes(right_attrs);
+
+    left_tuple = Tuple(left_buffer, left_attrs);
+    right_tuple = Tuple(right_buffer, right_attrs);
+    group_tuple = Tuple(NULL, right_attrs);  //Points into the group
+    lhs_index = Tuple::getIndex(left_attrs, condition.lhsAttr);
+    rhs_index = Tuple::getIndex(right_attrs, condition.rhsAttr);
+}
+
+RC SMJoin::getNextTuple(void* data) {
+    //getNextTuple is being called for the first time
+    if (!started) {
+        started = true;
+        advanceLeft();
+        advanceRight();
+    }
+
+    while (true) {
+        if (in_group) {
+            //Pair the left tuple with the rest of the group
+            if (group_pos < group_offsets.size()) {
+                group_tuple.data = &group_tuples[group_offsets[group_pos++]];
+                group_tuple.parse();
+
+                //Build result tuple
+                Tuple::Builder result = Tuple::build(static_cast<char*>(data), left_attrs.size() + right_attrs.size());
+                result.appendValues(left_tuple);
+                result.appendValues(group_tuple);
+                return SUCCESS;
+            }
+
+            //The next left tuple may have the same value
+            advanceLeft();
+            if (!left_done && lhs.compareTo(group_value) == 0) {
+                group_pos = 0;
+                continue;
+            }
+            in_group = false;
+        }
+
+        //Move the side with the smaller value forward until the values match. NULL never joins
+        if (left_done || right_done) return QE_EOF;
+        if (lhs.data == NULL) {
+            advanceLeft();
+        } else if (rhs.data == NULL) {
+            advanceRight();
+        } else {
+            int cmp = lhs.compareTo(rhs);
+            if (cmp < 0) {
+                advanceLeft();
+            } else if (cmp > 0) {
+                advanceRight();
+            } else {
+                loadGroup();
+            }
+        }
+    }
+}
+
+void SMJoin::getAttributes(vector<Attribute>& attrs) const {
+    attrs.clear();
+
+    //Output attrs is concatenation of inputs
+    attrs.insert(attrs.end(), left_attrs.begin(), left_attrs.end());
+    attrs.insert(attrs.end(), right_attrs.begin(), right_attrs.end());
+}
+
+void SMJoin::advanceLeft() {
+    if (left_reader.getNextTuple(left_buffer) != SUCCESS) {
+        left_done = true;
+        return;
+    }
+    left_tuple.parse();
+    lhs = left_tuple.getValue(lhs_index);
+}
+
+void SMJoin::advanceRight() {
+    if (right_reader.getNextTuple(right_buffer) != SUCCESS) {
+        right_done = true;
+        return;
+    }
+    right_tuple.parse();
+    rhs = right_tuple.getValue(rhs_index);
+}
+
+//Read every right tuple with the current right value, leaving the first one after them in right_buffer
+void SMJoin::loadGroup() {
+    group_tuples.clear();
+    group_offsets.clear();
+
+    //The group's value is kept in its first tuple
+    AttrType type = rhs.type;
+    size_t value_offset = static_cast<char*>(rhs.data) - right_buffer;
+    do {
+        size_t size = right_tuple.getSize();
+        group_offsets.push_back(group_tuples.size());
+        group_tuples.insert(group_tuples.end(), right_buffer, right_buffer + size);
+        advanceRight();
+    } while (!right_done && rhs.compareTo(Value{type, &group_tuples[value_offset]}) == 0);
+
+    group_value = Value{type, &group_tuples[value_offset]};
+    group_pos = 0;
+    in_group = true;
+}
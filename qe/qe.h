@@ -1,7 +1,6 @@
 #ifndef _qe_h_
 #define _qe_h_
 
-#include <functional>
 #include <vector>
 
 #include "../ix/ix.h"
@@ -11,6 +10,15 @@
 #define QE_EOF (-1)  // end of the index scan
 #define SUCCESS 0
 
+#define QE_BATCH_SIZE 256  // Most tuples in a TupleBatch
+
+#define QE_AGG_INITIAL_SLOTS 64  // Starting size of the Aggregate hash table, always a power of 2
+
+#define QE_GHJ_MEMORY_SIZE (256 * PAGE_SIZE)  // Bytes of left tuples GHJoin keeps in memory before partitioning
+#define QE_GHJ_DEFAULT_PARTITIONS 16
+
+#define QE_SORT_DEFAULT_PAGES 256  // Pages of tuples Sort holds in memory, and so the most runs merged at once
+
 using namespace std;
 
 typedef enum { MIN = 0,
@@ -29,11 +37,10 @@ struct Value {
     void *data;     // value
 
     bool compare(CompOp op, const Value &other) const;
+    bool compare(const Predicate &predicate, const Value &other) const;  //For comparing many values with one operation
     size_t getSize() const;
-
-   private:
-    template <typename t>
-    function<bool(t, t)> getOperator(CompOp op) const;
+    int compareTo(const Value &other) const;  //Negative, 0 or positive like strcmp. NULL sorts first
+    uint32_t hash() const;                    //Equal values have equal hashes
 };
 
 struct Condition {
@@ -44,12 +51,23 @@ struct Condition {
     Value rhsValue;   // right-hand side value if bRhsIsAttr = FALSE
 };
 
+struct SortKey {
+    string attrName;  // attribute to order by
+    bool ascending;   // TRUE for ASC, FALSE for DESC
+};
+
+class TupleBatch;
+
 class Iterator {
     // All the relational operators and access methods are iterators.
    public:
     virtual RC getNextTuple(void *data) = 0;
     virtual void getAttributes(vector<Attribute> &attrs) const = 0;
     virtual ~Iterator(){};
+
+    // Replace the contents of batch with the next tuples, returning QE_EOF once there are none left.
+    // Don't mix with getNextTuple() on the same iterator. Unless overridden it calls getNextTuple() for each tuple.
+    virtual RC getNextBatch(TupleBatch &batch);
 };
 
 //Represent an iterator tuple
@@ -58,12 +76,15 @@ class Tuple {
     //Class for building a Tuple by appending values
     class Builder {
        public:
-        Tuple getTuple() const;
+        Tuple getTuple() const;  //Only once every value was appended with its name
         void appendValue(const Value &v, const string &attr_name);
+        void appendValue(const Value &v);
+        void appendValues(const Tuple &tuple);  //Every attribute of a parsed tuple
 
        private:
         vector<Attribute> attrs;
         const size_t num_attrs;
+        size_t num_appended;
 
         char *data;
         char *data_end;
@@ -74,16 +95,76 @@ class Tuple {
 
     Tuple(char *data_ = NULL, vector<Attribute> attrs_ = {}) : attrs(attrs_), data(data_) {}
     Value getValue(const string &attr_name) const;
+    Value getValue(int index) const;  //Attribute at index as found by parse(), invalid if index is -1
+    size_t getSize() const;           //Total bytes of the tuple including the null bitmap
+
+    //Find where each attribute of data starts. Needed again whenever data changes
+    void parse();
+
+    //Position of an attribute, -1 if there is none. Operators look it up once instead of by name for every tuple
+    static int getIndex(const vector<Attribute> &attrs, const string &attr_name);
 
     //Return a new Tuple::Builder
     static Builder build(char *data_, size_t num_attrs_) { return Builder(data_, num_attrs_); };
 
     vector<Attribute> attrs;
     char *data;
+    vector<uint32_t> offsets;  //Offset of each attribute in data, NULL_OFFSET if it is null
+
+    static const uint32_t NULL_OFFSET = (uint32_t)-1;
 
-    bool isNull(size_t index) const {
-        return (*(data + (index / CHAR_BIT)) << (index % CHAR_BIT)) & 0x8;
-    }  //Is attribute null at index?
+    bool isNull(size_t index) const { return isNull(data, index); }  //Is attribute null at index?
+    static bool isNull(const char *data, size_t index) {
+        return static_cast<unsigned char>(data[index / CHAR_BIT]) & (0x80 >> (index % CHAR_BIT));
+    }
+};
+
+//Up to QE_BATCH_SIZE tuples passed between iterators by getNextBatch().
+//Along with each tuple the offset of every attribute in it is kept, so values are found by position
+//without walking the tuple again.
+class TupleBatch {
+   public:
+    TupleBatch() : used(0){};
+
+    //Empty the batch and set the attributes of the tuples it will hold
+    void reset(const vector<Attribute> &attrs_);
+    size_t size() const { return tuple_offsets.size(); }
+    bool full() const { return size() >= QE_BATCH_SIZE; }
+
+    //Space for writing the next tuple, which is added by commitTuple(). Valid until the next call
+    char *nextTuple();
+    void commitTuple();
+    //Copy a tuple of another batch with the same attributes
+    void addTuple(const TupleBatch &other, size_t i);
+
+    const char *getTuple(size_t i) const { return &data[tuple_offsets[i]]; }
+    size_t getTupleSize(size_t i) const;
+    Value getValue(size_t i, size_t column) const;
+    int getColumn(const string &attr_name) const;  //Position of an attribute, -1 if there is none
+
+    vector<Attribute> attrs;
+
+   private:
+    static const uint32_t NULL_COLUMN = (uint32_t)-1;
+
+    vector<char> data;  //Tuples back to back
+    size_t used;
+    vector<size_t> tuple_offsets;
+    vector<uint32_t> column_offsets;  //attrs.size() per tuple, NULL_COLUMN if the value is null
+};
+
+//Reads an iterator a batch at a time for operators that work on one tuple at a time
+class BatchReader {
+   public:
+    BatchReader(Iterator *input_) : input(input_), pos(0){};
+
+    //Copy the next tuple to data
+    RC getNextTuple(void *data);
+
+   private:
+    Iterator *input;
+    TupleBatch batch;
+    size_t pos;
 };
 
 class TableScan : public Iterator {
@@ -92,13 +173,20 @@ class TableScan : public Iterator {
     RelationManager &rm;
     RM_ScanIterator *iter;
     string tableName;
+    string relName;  // Name of the table in the catalog, tableName may be an alias
     vector<Attribute> attrs;
     vector<string> attrNames;
     RID rid;
 
-    TableScan(RelationManager &rm, const string &tableName, const char *alias = NULL) : rm(rm) {
+    // Condition evaluated by the record scan itself, NO_OP unless pushed down by a Filter
+    string conditionAttr;
+    CompOp compOp;
+    const void *value;
+
+    TableScan(RelationManager &rm, const string &tableName, const char *alias = NULL) : rm(rm), compOp(NO_OP), value(NULL) {
         //Set members
         this->tableName = tableName;
+        this->relName = tableName;
 
         // Get Attributes from RM
         rm.getAttributes(tableName, attrs);
@@ -123,13 +211,52 @@ class TableScan : public Iterator {
         iter->close();
         delete iter;
         iter = new RM_ScanIterator();
-        rm.scan(tableName, "", NO_OP, NULL, attrNames, *iter);
+        rm.scan(relName, conditionAttr, compOp, value, attrNames, *iter);
+    };
+
+    // Have the record scan only return tuples where attr (named rel.attr) op v holds, checking them
+    // inside the page instead of in a Filter. Only one condition can be pushed down, and a NULL v never is.
+    // Returns false if the condition wasn't pushed down.
+    bool pushCondition(const string &attr, CompOp op, const Value &v) {
+        int index = getAttrIndex(attr);
+        if (compOp != NO_OP || op == NO_OP || v.data == NULL || index < 0 || attrs[index].type != v.type) return false;
+
+        conditionAttr = attrs[index].name;
+        compOp = op;
+        value = v.data;
+        setIterator();
+        return true;
+    };
+
+    // Have the record scan only return the given attributes (named rel.attr), in that order.
+    // Returns false if one of them isn't returned by the scan.
+    bool pushProjection(const vector<string> &names) {
+        vector<Attribute> projected;
+        for (const string &name : names) {
+            int index = getAttrIndex(name);
+            if (index < 0) return false;
+            projected.push_back(attrs[index]);
+        }
+
+        attrs = projected;
+        attrNames.clear();
+        for (const Attribute &attr : attrs) attrNames.push_back(attr.name);
+        setIterator();
+        return true;
     };
 
     RC getNextTuple(void *data) {
         return iter->getNextTuple(rid, data);
     };
 
+    RC getNextBatch(TupleBatch &batch) {
+        vector<Attribute> attrs;
+        getAttributes(attrs);
+        batch.reset(attrs);
+        while (!batch.full() && iter->getNextTuple(rid, batch.nextTuple()) == SUCCESS) batch.commitTuple();
+        return (batch.size() > 0) ? SUCCESS : QE_EOF;
+    };
+
     void getAttributes(vector<Attribute> &attrs) const {
         attrs.clear();
         attrs = this->attrs;
@@ -147,6 +274,17 @@ class TableScan : public Iterator {
     ~TableScan() {
         iter->close();
     };
+
+   private:
+    // Position in attrs of an attribute named rel.attr, -1 if the scan doesn't return it
+    int getAttrIndex(const string &name) const {
+        string prefix = tableName + ".";
+        if (name.compare(0, prefix.size(), prefix) != 0) return -1;
+        for (unsigned i = 0; i < attrs.size(); i++) {
+            if (name.compare(prefix.size(), string::npos, attrs[i].name) == 0) return i;
+        }
+        return -1;
+    };
 };
 
 class IndexScan : public Iterator {
@@ -155,14 +293,17 @@ class IndexScan : public Iterator {
     RelationManager &rm;
     RM_IndexScanIterator *iter;
     string tableName;
+    string relName;  // Name of the table in the catalog, tableName may be an alias
     string attrName;
     vector<Attribute> attrs;
     char key[PAGE_SIZE];
     RID rid;
+    bool ranged;  // Has the scan been narrowed from the whole index
 
-    IndexScan(RelationManager &rm, const string &tableName, const string &attrName, const char *alias = NULL) : rm(rm) {
+    IndexScan(RelationManager &rm, const string &tableName, const string &attrName, const char *alias = NULL) : rm(rm), ranged(false) {
         // Set members
         this->tableName = tableName;
+        this->relName = tableName;
         this->attrName = attrName;
 
         // Get Attributes from RM
@@ -176,26 +317,53 @@ class IndexScan : public Iterator {
         if (alias) this->tableName = alias;
     };
 
-    // Start a new iterator given the new key range
+    // Start over with a new key range, searching the index that is already open
     void setIterator(void *lowKey,
                      void *highKey,
                      bool lowKeyInclusive,
                      bool highKeyInclusive) {
-        iter->close();
-        delete iter;
-        iter = new RM_IndexScanIterator();
-        rm.indexScan(tableName, attrName, lowKey, highKey, lowKeyInclusive,
-                     highKeyInclusive, *iter);
+        iter->reset(lowKey, highKey, lowKeyInclusive, highKeyInclusive);
+        ranged = true;
+    };
+
+    // Narrow a scan of the whole index to the keys where attr (named rel.attr) op v holds, so only those
+    // tuples are read. Tuples are still checked by the Filter above. Returns false if the scan wasn't narrowed.
+    bool pushCondition(const string &attr, CompOp op, const Value &v) {
+        if (ranged || v.data == NULL || attr != tableName + "." + attrName) return false;
+        for (const Attribute &a : attrs) {
+            if (a.name == attrName && a.type != v.type) return false;
+        }
+
+        switch (op) {
+            case EQ_OP: setIterator(v.data, v.data, true, true); break;
+            case LT_OP: setIterator(NULL, v.data, true, false); break;
+            case LE_OP: setIterator(NULL, v.data, true, true); break;
+            case GT_OP: setIterator(v.data, NULL, false, true); break;
+            case GE_OP: setIterator(v.data, NULL, true, true); break;
+            default: return false;
+        }
+        return true;
     };
 
     RC getNextTuple(void *data) {
         int rc = iter->getNextEntry(rid, key);
         if (rc == 0) {
-            rc = rm.readTuple(tableName.c_str(), rid, data);
+            rc = rm.readTuple(relName.c_str(), rid, data);
         }
         return rc;
     };
 
+    RC getNextBatch(TupleBatch &batch) {
+        vector<Attribute> attrs;
+        getAttributes(attrs);
+        batch.reset(attrs);
+        while (!batch.full() && iter->getNextEntry(rid, key) == SUCCESS) {
+            if (rm.readTuple(relName, rid, batch.nextTuple()) != SUCCESS) break;
+            batch.commitTuple();
+        }
+        return (batch.size() > 0) ? SUCCESS : QE_EOF;
+    };
+
     void getAttributes(vector<Attribute> &attrs) const {
         attrs.clear();
         attrs = this->attrs;
@@ -228,10 +396,17 @@ class Filter : public Iterator {
     ~Filter(){};
 
     RC getNextTuple(void *data);
+    RC getNextBatch(TupleBatch &batch);
     // For attribute in vector<Attribute>, name it as rel.attr
     void getAttributes(vector<Attribute> &attrs_) const;
 
    private:
+    TupleBatch input_batch;
+    Tuple tuple;          //Tuple being checked
+    int lhs_index;        //Position of lhsAttr in attrs
+    Predicate predicate;  //condition.op on rhsValue's type
+    bool pushed;          //Is the condition checked by the TableScan below
+
     bool isFilteredTuple(void *data);
 };
 
@@ -250,8 +425,15 @@ class Project : public Iterator {
     ~Project(){};
 
     RC getNextTuple(void *data);
+    RC getNextBatch(TupleBatch &batch);
     // For attribute in vector<Attribute>, name it as rel.attr
-    void getAttributes(vector<Attribute> &attrs) const;
+    void getAttributes(vector<Attribute> &attrs_) const;
+
+   private:
+    TupleBatch input_batch;
+    vector<Attribute> attrs;  //Output attributes
+    vector<int> indices;      //Position in input_attrs of each output attribute
+    bool pushed;              //Does the TableScan below already return just the output attributes
 };
 
 class INLJoin : public Iterator {
@@ -283,7 +465,326 @@ class INLJoin : public Iterator {
     void getAttributes(vector<Attribute> &attrs) const;
 
    private:
+    BatchReader left_reader;
+    int lhs_index;  //Position of lhsAttr in left_attrs
+
     RC getNextOuterTuple();
 };
 
+class Aggregate : public Iterator {
+    // Aggregation operator
+    // Results are always REAL. NULL values are skipped, and groups with no values left give NULL (0 for COUNT)
+   public:
+    Iterator *input;
+    Attribute aggAttr;
+    Attribute groupAttr;
+    AggregateOp op;
+    bool grouped;
+
+    vector<Attribute> input_attrs;
+    char buffer[PAGE_SIZE];  //Buffer for parsing tuples
+
+    Tuple source;
+
+    // Basic aggregation
+    Aggregate(Iterator *input_,    // Iterator of input R
+              Attribute aggAttr_,  // The attribute over which we are computing an aggregate
+              AggregateOp op_      // Aggregate operation
+    );
+
+    // Group-based hash aggregation
+    Aggregate(Iterator *input_,      // Iterator of input R
+              Attribute aggAttr_,    // The attribute over which we are computing an aggregate
+              Attribute groupAttr_,  // The attribute over which we are grouping the tuples
+              AggregateOp op_        // Aggregate operation
+    );
+    ~Aggregate(){};
+
+    RC getNextTuple(void *data);
+    // Output attribute is named as aggregateOp(aggAttr), e.g. MAX(rel.attr)
+    void getAttributes(vector<Attribute> &attrs) const;
+
+   private:
+    BatchReader reader;
+    int agg_index;  //Positions of aggAttr and groupAttr in input_attrs
+    int group_index;
+
+    //Running values of one group
+    struct Accumulator {
+        double sum;
+        float min;
+        float max;
+        unsigned count;
+    };
+
+    //Hash table slot pointing at a group, group is 0 when the slot is empty
+    struct Slot {
+        uint32_t hash;
+        uint32_t group;  //Group index + 1
+    };
+
+    //Groups are numbered in the order they are first seen and output in that order
+    vector<Slot> slots;                //Open addressing with linear probing
+    vector<Accumulator> accumulators;  //One per group, next to each other
+    vector<char> group_values;         //Group values back to back
+    vector<size_t> group_offsets;      //Offset of each group value, NULL_GROUP for the NULL group
+    size_t null_group;
+
+    bool consumed;      //Has the input been read
+    size_t next_group;  //Next group to output
+
+    static const size_t NULL_GROUP = (size_t)-1;
+
+    RC consumeInput();
+    size_t findGroup(const Value &v);
+    size_t addGroup(const Value &v, uint32_t hash);
+    void growTable();
+    void accumulate(Accumulator &acc, const Value &v);
+    bool getResult(const Accumulator &acc, float &result) const;
+};
+
+class GHJoin : public Iterator {
+    // Grace hash join operator
+    // Joins on lhsAttr = rhsAttr. The left input is the build side and is hashed in memory when it fits in
+    // QE_GHJ_MEMORY_SIZE, otherwise both inputs are first partitioned by hash into temporary record files
+    // and each pair of partitions is joined in memory.
+   public:
+    Iterator *leftIn;
+    Iterator *rightIn;
+    const Condition &condition;
+    const unsigned numPartitions;
+
+    vector<Attribute> left_attrs;
+    vector<Attribute> right_attrs;
+    char left_buffer[PAGE_SIZE];  //Buffer for parsing tuples
+    char right_buffer[PAGE_SIZE];
+
+    Tuple left_tuple;
+    Tuple right_tuple;
+
+    GHJoin(Iterator *leftIn_,                                      // Iterator of input R
+           Iterator *rightIn_,                                     // Iterator of input S
+           const Condition &condition_,                            // Join condition (CompOp is always EQ)
+           const unsigned numPartitions_ = QE_GHJ_DEFAULT_PARTITIONS  // # of partitions for each relation if it doesn't fit
+    );
+    ~GHJoin();
+
+    RC getNextTuple(void *data);
+    // For attribute in vector<Attribute>, name it as rel.attr
+    void getAttributes(vector<Attribute> &attrs) const;
+
+   private:
+    BatchReader left_reader;
+    BatchReader right_reader;
+    int lhs_index;  //Positions of the join attributes in left_attrs and right_attrs
+    int rhs_index;
+    Predicate equal;
+
+    //Hash table of left tuples, chained through build_next
+    vector<char> build_tuples;  //Tuples back to back
+    vector<size_t> build_offsets;
+    vector<uint32_t> build_hashes;
+    vector<size_t> build_next;
+    vector<size_t> buckets;
+
+    //Right tuple being probed
+    Value rhs;
+    uint32_t rhs_hash;
+    size_t match;  //Next left tuple in the chain to check, NO_MATCH once the chain is done
+
+    bool started;
+    bool partitioned;
+    unsigned partition;  //Partition pair being joined
+    vector<string> left_partitions;
+    vector<string> right_partitions;
+    FileHandle partition_handle;
+    RBFM_ScanIterator partition_scan;  //Scan of the right partition
+    bool partition_open;
+
+    static unsigned joinCounter;  //Keeps temporary file names unique
+    static const size_t NO_MATCH = (size_t)-1;
+
+    RC build();
+    void addBuildTuple(const char *tuple, size_t size, uint32_t hash);
+    void buildTable();
+    RC createPartitions();
+    RC writePartition(FileHandle &fileHandle, const vector<Attribute> &attrs, const void *tuple);
+    RC partitionRight();
+    RC openPartition(unsigned p);
+    void closePartition();
+    RC getNextRightTuple();
+    size_t getBucket(uint32_t hash) const { return (hash / numPartitions) & (buckets.size() - 1); }
+};
+
+class BNLJoin : public Iterator {
+    // Block nested-loop join operator
+    // Joins when lhsAttr op rhsAttr holds, or when lhsAttr op rhsValue holds if bRhsIsAttr is false.
+    // The right input is read once for every block of left tuples.
+   public:
+    Iterator *leftIn;
+    TableScan *rightIn;
+    const Condition &condition;
+    const unsigned numPages;
+
+    vector<Attribute> left_attrs;
+    vector<Attribute> right_attrs;
+    char left_buffer[PAGE_SIZE];  //Buffer for parsing tuples
+    char right_buffer[PAGE_SIZE];
+
+    Tuple left_tuple;
+    Tuple right_tuple;
+
+    BNLJoin(Iterator *leftIn_,             // Iterator of input R
+            TableScan *rightIn_,           // TableScan Iterator of input S
+            const Condition &condition_,   // Join condition
+            const unsigned numPages_       // # of pages of left tuples held in memory at a time
+    );
+    ~BNLJoin(){};
+
+    RC getNextTuple(void *data);
+    // For attribute in vector<Attribute>, name it as rel.attr
+    void getAttributes(vector<Attribute> &attrs) const;
+
+   private:
+    BatchReader left_reader;
+    int lhs_index;  //Positions of the join attributes in left_attrs and right_attrs, rhs_index is -1 without rhsAttr
+    int rhs_index;
+    Predicate predicate;  //condition.op on the join attributes' type
+
+    //Left tuples of the current block and their join values
+    vector<char> block_tuples;
+    vector<size_t> block_offsets;
+    vector<Value> block_values;
+    size_t block_pos;  //Next left tuple of the block to check against the right tuple
+
+    Value rhs;          //Join value of the current right tuple
+    bool started;
+    bool left_pending;  //left_buffer holds a tuple that didn't fit in the last block
+    bool left_done;
+
+    RC loadBlock();
+};
+
+class Sort : public Iterator {
+    // External merge sort operator
+    // Orders its input by each key in turn. Sorted runs of up to numPages pages are written to temporary
+    // record files when the input doesn't fit in memory, then merged numPages - 1 at a time with one page of output.
+    // Tuples with equal keys keep their input order.
+   public:
+    Iterator *input;
+    const vector<SortKey> keys;
+    const unsigned numPages;
+
+    vector<Attribute> attrs;
+    char buffer[PAGE_SIZE];  //Buffer for parsing tuples
+
+    Sort(Iterator *input_,                              // Iterator of input R
+         const vector<SortKey> &keys_,                  // Attributes to order by, most significant first
+         const unsigned numPages_ = QE_SORT_DEFAULT_PAGES  // # of pages that can be used for sorting
+    );
+    ~Sort();
+
+    RC getNextTuple(void *data);
+    void getAttributes(vector<Attribute> &attrs) const;
+
+   private:
+    BatchReader reader;
+    vector<int> key_indices;  //Position of each key in attrs
+
+    //Sorted run on disk being merged
+    struct RunReader {
+        string fileName;
+        FileHandle fileHandle;
+        RBFM_ScanIterator scan;
+        char tuple[PAGE_SIZE];
+        Tuple source;
+        size_t size;           //Bytes in tuple
+        vector<Value> values;  //Sort keys of tuple
+        bool done;
+    };
+
+    //Tuples of the run being built, and their sort keys, keys.size() values per tuple
+    vector<char> run_tuples;
+    vector<size_t> run_offsets;
+    vector<Value> run_values;
+    vector<size_t> run_order;  //Tuples in sorted order
+    size_t next_tuple;         //Next tuple to output when everything fit in memory
+
+    vector<string> run_files;   //Runs not merged yet
+    vector<RunReader *> readers;
+    vector<size_t> losers;      //Loser tree over readers, losers[0] is the winner
+
+    bool started;
+    bool in_memory;
+
+    static unsigned sortCounter;  //Keeps temporary file names unique
+
+    RC createRuns();
+    void sortRun();
+    RC writeRun();
+    RC appendRun(FileHandle &fileHandle);
+    RC mergeRuns(size_t first, size_t count, string &fileName);
+    RC openReaders(size_t first, size_t count);
+    void closeReaders();
+    RC advanceReader(size_t r);
+    bool isGreater(size_t a, size_t b) const;
+    void adjust(size_t r);
+    int compareTuples(const Value *lhs, const Value *rhs) const;
+    void getKeyValues(const Tuple &tuple, Value *values) const;
+};
+
+class SMJoin : public Iterator {
+    // Sort-merge join operator
+    // Joins on lhsAttr = rhsAttr. Both inputs must already be in ascending order of their join attribute,
+    // e.g. an IndexScan or a Sort. Right tuples sharing a join value are held in memory while the left
+    // tuples with that value are matched against them.
+   public:
+    Iterator *leftIn;
+    Iterator *rightIn;
+    const Condition &condition;
+
+    vector<Attribute> left_attrs;
+    vector<Attribute> right_attrs;
+    char left_buffer[PAGE_SIZE];  //Buffer for parsing tuples
+    char right_buffer[PAGE_SIZE];
+
+    Tuple left_tuple;
+    Tuple right_tuple;
+
+    SMJoin(Iterator *leftIn_,           // Iterator of input R, ordered by lhsAttr
+           Iterator *rightIn_,          // Iterator of input S, ordered by rhsAttr
+           const Condition &condition_  // Join condition (CompOp is always EQ)
+    );
+    ~SMJoin(){};
+
+    RC getNextTuple(void *data);
+    // For attribute in vector<Attribute>, name it as rel.attr
+    void getAttributes(vector<Attribute> &attrs) const;
+
+   private:
+    BatchReader left_reader;
+    BatchReader right_reader;
+    int lhs_index;  //Positions of the join attributes in left_attrs and right_attrs
+    int rhs_index;
+
+    //Right tuples with the same join value
+    vector<char> group_tuples;
+    vector<size_t> group_offsets;
+    Value group_value;
+    size_t group_pos;  //Next right tuple of the group to pair with the left tuple
+    bool in_group;
+
+    Value lhs;  //Join values of left_buffer and right_buffer
+    Value rhs;
+    bool started;
+    bool left_done;
+    bool right_done;
+
+    Tuple group_tuple;
+
+    void advanceLeft();
+    void advanceRight();
+    void loadGroup();
+};
+
 #endif
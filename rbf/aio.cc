@@ -0,0 +1,359 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if !defined(AIO_NO_IO_URING) && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#include "aio.h"
+
+// Reads, writes and the probe for them came with Linux 5.6, before IORING_FEAT_FAST_POLL
+#if defined(IORING_FEAT_FAST_POLL) && defined(__NR_io_uring_setup)
+#define AIO_IO_URING
+#endif
+
+AsyncIOManager* AsyncIOManager::_aio_manager = NULL;
+
+AsyncIOManager* AsyncIOManager::instance()
+{
+    if(!_aio_manager)
+        _aio_manager = new AsyncIOManager();
+
+    return _aio_manager;
+}
+
+
+AsyncIOManager::AsyncIOManager()
+: inFlight(0), reaping(false), ringFd(NO_FD), ring(NULL), ringSize(0), sqes(NULL), cqes(NULL), sqEntries(0)
+{
+    if (setupIOUring())
+        return;
+
+    // Workers live as long as the process, blocked on the queue when there is nothing to do
+    for (unsigned i = 0; i < AIO_WORKERS; i++)
+        thread(&AsyncIOManager::work, this).detach();
+}
+
+
+RC AsyncIOManager::submit(IORequest *requests, unsigned count)
+{
+    unique_lock<mutex> lock(latch);
+    for (unsigned i = 0; i < count; i++)
+    {
+        requests[i].done = false;
+        requests[i].rc = SUCCESS;
+    }
+
+    if (ringFd != NO_FD)
+        return submitToRing(lock, requests, count);
+
+    for (unsigned i = 0; i < count; i++)
+        queue.push_back(&requests[i]);
+    inFlight += count;
+    queued.notify_all();
+    return SUCCESS;
+}
+
+
+RC AsyncIOManager::wait(IORequest *requests, unsigned count)
+{
+    unique_lock<mutex> lock(latch);
+    RC result = SUCCESS;
+    for (unsigned i = 0; i < count; i++)
+    {
+        IORequest &request = requests[i];
+        while (!request.done)
+        {
+            RC rc = waitForCompletion(lock);
+            if (rc)
+                return rc;
+        }
+
+        if (request.rc && result == SUCCESS)
+            result = request.rc;
+    }
+    return result;
+}
+
+
+RC AsyncIOManager::execute(IORequest *requests, unsigned count)
+{
+    RC rc = submit(requests, count);
+    // Requests that were started have to finish before the caller can reuse them
+    RC waitRC = wait(requests, count);
+    return rc ? rc : waitRC;
+}
+
+
+bool AsyncIOManager::usingIOUring()
+{
+    return ringFd != NO_FD;
+}
+
+// Private helper methods ///////////////////////////////////////////////////////////////////
+
+void AsyncIOManager::complete(IORequest &request, ssize_t result)
+{
+    if (result == (ssize_t) request.pages * PAGE_SIZE)
+        request.rc = SUCCESS;
+    else
+        request.rc = request.write ? FH_WRITE_FAILED : FH_READ_FAILED;
+    request.done = true;
+    inFlight--;
+}
+
+// Wait until at least one more request has completed. Only one thread at a time waits on the ring, with the latch
+// released so others can keep submitting meanwhile. It collects the completions for everyone and wakes the rest
+RC AsyncIOManager::waitForCompletion(unique_lock<mutex> &lock)
+{
+    if (ringFd == NO_FD || reaping)
+    {
+        completed.wait(lock);
+        return SUCCESS;
+    }
+
+    // Completions may already be waiting in the ring
+    unsigned pending = inFlight;
+    reapRing();
+    if (inFlight != pending)
+    {
+        completed.notify_all();
+        return SUCCESS;
+    }
+
+    reaping = true;
+    lock.unlock();
+    RC rc = waitRing();
+    lock.lock();
+    reaping = false;
+
+    reapRing();
+    completed.notify_all();
+    return rc;
+}
+
+// Worker thread: take requests off the queue and do them with pread/pwrite
+void AsyncIOManager::work()
+{
+    unique_lock<mutex> lock(latch);
+    while (true)
+    {
+        queued.wait(lock, [this] { return !queue.empty(); });
+        IORequest *request = queue.front();
+        queue.pop_front();
+
+        lock.unlock();
+        off_t offset = (off_t) PAGE_SIZE * request->pageNum;
+        size_t length = (size_t) PAGE_SIZE * request->pages;
+        ssize_t result;
+        if (request->write)
+            result = pwrite(request->fd, request->data, length, offset);
+        else
+            result = pread(request->fd, request->data, length, offset);
+        lock.lock();
+
+        complete(*request, result);
+        completed.notify_all();
+    }
+}
+
+#ifdef AIO_IO_URING
+
+AsyncIOManager::~AsyncIOManager()
+{
+    if (ringFd == NO_FD)
+        return;
+
+    munmap(sqes, sqEntries * sizeof(io_uring_sqe));
+    munmap(ring, ringSize);
+    close(ringFd);
+}
+
+// Map the rings of a new io_uring instance. Returns false if the kernel doesn't let us use one for page I/O
+bool AsyncIOManager::setupIOUring()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, AIO_QUEUE_DEPTH, &params);
+    if (fd < 0)
+        return false;
+
+    // Make sure reads and writes are supported, and that both rings share one mapping
+    unsigned probeOps = IORING_OP_WRITE + 1;
+    io_uring_probe *probe = (io_uring_probe*) calloc(1, sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op));
+    bool supported = (params.features & IORING_FEAT_SINGLE_MMAP)
+        && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, probeOps) == 0
+        && probe->last_op >= IORING_OP_WRITE
+        && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+        && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!supported)
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ringSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+    ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    void *sqeMap = mmap(NULL, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqeMap == MAP_FAILED)
+    {
+        munmap(ring, ringSize);
+        close(fd);
+        return false;
+    }
+
+    char *base = (char*) ring;
+    sqHead  = (unsigned*) (base + params.sq_off.head);
+    sqTail  = (unsigned*) (base + params.sq_off.tail);
+    sqMask  = (unsigned*) (base + params.sq_off.ring_mask);
+    sqArray = (unsigned*) (base + params.sq_off.array);
+    cqHead  = (unsigned*) (base + params.cq_off.head);
+    cqTail  = (unsigned*) (base + params.cq_off.tail);
+    cqMask  = (unsigned*) (base + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*) (base + params.cq_off.cqes);
+    sqes = (io_uring_sqe*) sqeMap;
+    sqEntries = params.sq_entries;
+    ringFd = fd;
+    return true;
+}
+
+// Fill in a submission queue entry for each request and hand them to the kernel, making room when the ring is full.
+// Everything in the submission queue has been handed to the kernel whenever the latch is released
+RC AsyncIOManager::submitToRing(unique_lock<mutex> &lock, IORequest *requests, unsigned count)
+{
+    unsigned i = 0;
+    while (i < count)
+    {
+        // The completion queue is twice as long, so it can't overflow while at most sqEntries are in flight
+        if (inFlight == sqEntries)
+        {
+            RC rc = enterRing();
+            if (rc == SUCCESS)
+                rc = waitForCompletion(lock);
+            if (rc)
+            {
+                // Requests that never made it into the ring fail right away
+                for (; i < count; i++)
+                {
+                    requests[i].rc = rc;
+                    requests[i].done = true;
+                }
+                return rc;
+            }
+            continue;
+        }
+
+        IORequest &request = requests[i++];
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = request.fd;
+        sqe.addr = (uintptr_t) request.data;
+        sqe.len = PAGE_SIZE * request.pages;
+        sqe.off = (uint64_t) PAGE_SIZE * request.pageNum;
+        sqe.user_data = (uintptr_t) &request;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        inFlight++;
+    }
+    return enterRing();
+}
+
+// Submit everything in the submission queue without waiting for any of it
+RC AsyncIOManager::enterRing()
+{
+    while (true)
+    {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        unsigned toSubmit = *sqTail - head;
+        if (syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, 0, NULL, 0) >= 0)
+            return SUCCESS;
+        if (errno == EINTR)
+            continue;
+
+        // The kernel didn't take the remaining entries, so fail their requests instead of leaving them in the ring
+        head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        for (unsigned tail = *sqTail; head != tail; head++)
+        {
+            IORequest *request = (IORequest*) (uintptr_t) sqes[sqArray[head & *sqMask]].user_data;
+            complete(*request, -1);
+        }
+        __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+        return FH_READ_FAILED;
+    }
+}
+
+// Block until at least one request has completed. Nothing is submitted, so the latch doesn't have to be held
+RC AsyncIOManager::waitRing()
+{
+    while (true)
+    {
+        if (syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) >= 0)
+            return SUCCESS;
+        if (errno != EINTR)
+            return FH_READ_FAILED;
+    }
+}
+
+// Mark the request of every entry in the completion queue as done
+void AsyncIOManager::reapRing()
+{
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+        io_uring_cqe &cqe = cqes[head & *cqMask];
+        IORequest *request = (IORequest*) (uintptr_t) cqe.user_data;
+        complete(*request, cqe.res);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+#else
+
+AsyncIOManager::~AsyncIOManager()
+{
+}
+
+bool AsyncIOManager::setupIOUring()
+{
+    return false;
+}
+
+RC AsyncIOManager::submitToRing(unique_lock<mutex> &lock, IORequest *requests, unsigned count)
+{
+    return FH_READ_FAILED;
+}
+
+RC AsyncIOManager::enterRing()
+{
+    return FH_READ_FAILED;
+}
+
+RC AsyncIOManager::waitRing()
+{
+    return FH_READ_FAILED;
+}
+
+void AsyncIOManager::reapRing()
+{
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef _aio_h_
+#define _aio_h_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "pfm.h"
+
+// Requests the engine keeps in flight at once
+#define AIO_QUEUE_DEPTH 64
+// Threads doing the I/O when io_uring can't be used
+#define AIO_WORKERS     4
+
+using namespace std;
+
+// A read or write of consecutive pages given to AsyncIOManager. It must stay in place until it has completed
+typedef struct IORequest
+{
+    int fd;
+    PageNum pageNum;
+    unsigned pages;
+    byte *data;  // Holds all of the pages
+    bool write;
+    bool done;   // Set once the request has completed
+    RC rc;       // Result of the request once it is done
+} IORequest;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// Process-wide engine for page reads and writes that complete in the background.
+// Requests are submitted, then waited on, so many of them can be in flight at once.
+// Uses io_uring when the kernel supports it and a pool of worker threads doing pread/pwrite otherwise.
+// Build with -DAIO_NO_IO_URING to always use the worker threads.
+// All methods are safe to call from several threads. A thread waiting for its requests doesn't stop others from submitting theirs.
+class AsyncIOManager
+{
+public:
+    static AsyncIOManager* instance();                                  // Access to the _aio_manager instance
+
+    RC submit(IORequest *requests, unsigned count);                     // Start count requests
+    RC wait(IORequest *requests, unsigned count);                       // Wait for count submitted requests, returning the first error
+    RC execute(IORequest *requests, unsigned count);                    // Submit count requests and wait for all of them
+
+    bool usingIOUring();
+
+protected:
+    AsyncIOManager();                                                   // Constructor
+    ~AsyncIOManager();                                                  // Destructor
+
+private:
+    static AsyncIOManager *_aio_manager;
+
+    mutex latch;
+    condition_variable queued;      // Signalled when a request is added to queue
+    condition_variable completed;   // Signalled when a request completes
+    deque<IORequest*> queue;        // Requests waiting for a worker thread
+    unsigned inFlight;
+    bool reaping;                   // A thread is waiting on the ring for completions with latch released
+
+    // io_uring state, ringFd is NO_FD when the worker threads are used
+    int ringFd;
+    void *ring;
+    size_t ringSize;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    unsigned sqEntries;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+
+    // Private helper methods
+    bool setupIOUring();
+    RC submitToRing(unique_lock<mutex> &lock, IORequest *requests, unsigned count);
+    RC enterRing();
+    RC waitRing();
+    void reapRing();
+    RC waitForCompletion(unique_lock<mutex> &lock);
+    void work();
+    void complete(IORequest &request, ssize_t result);
+};
+
+#endif
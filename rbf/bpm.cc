@@ -0,0 +1,556 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "bpm.h"
+#include "aio.h"
+
+BufferManager* BufferManager::_bp_manager = NULL;
+
+BufferManager* BufferManager::instance()
+{
+    if(!_bp_manager)
+    {
+        _bp_manager = new BufferManager();
+        // Dirty pages of files that were never closed still reach the disk
+        atexit(flushAtExit);
+    }
+
+    return _bp_manager;
+}
+
+
+BufferManager::BufferManager()
+: pool(NULL), clockHand(0), hitCounter(0), missCounter(0)
+{
+    allocateFrames(BPM_DEFAULT_FRAMES);
+    // Start the I/O engine now, before threads using the pool can race to create it
+    AsyncIOManager::instance();
+}
+
+
+BufferManager::~BufferManager()
+{
+    flushAll();
+    free(pool);
+}
+
+
+RC BufferManager::setNumberOfFrames(unsigned n)
+{
+    unique_lock<mutex> lock(latch);
+
+    if (n == 0)
+        return FH_NO_FREE_FRAME;
+
+    // The latch is released while dirty pages are written back, so keep checking until nothing is left to write
+    while (true)
+    {
+        // Can't move pages out from under a caller
+        vector<unsigned> frameNums;
+        for (unsigned i = 0; i < frames.size(); i++)
+        {
+            if (frames[i].pinCount > 0 || frames[i].io)
+                return FH_NO_FREE_FRAME;
+            if (frames[i].used && frames[i].dirty)
+                frameNums.push_back(i);
+        }
+        if (frameNums.empty())
+            break;
+
+        RC rc = writeBack(lock, frameNums);
+        if (rc)
+            return rc;
+    }
+
+    allocateFrames(n);
+    return SUCCESS;
+}
+
+
+unsigned BufferManager::getNumberOfFrames()
+{
+    lock_guard<mutex> guard(latch);
+    return frames.size();
+}
+
+
+RC BufferManager::pinPage(int fd, FileID file, PageNum pageNum, bool load, byte *&page, bool &hit)
+{
+    unique_lock<mutex> lock(latch);
+    PageKey key = {file, pageNum};
+
+    unsigned frameNum;
+    while (true)
+    {
+        // The page is being written, so what is in the pool or the file now is about to change
+        if (isBeingWritten(key))
+        {
+            frameReleased.wait(lock);
+            continue;
+        }
+
+        // Page is already in the pool
+        auto entry = pageTable.find(key);
+        if (entry != pageTable.end())
+        {
+            Frame &frame = frames[entry->second];
+            // Another thread is reading or writing the page. Look again once it is done, since a failed read drops it
+            if (frame.io)
+            {
+                frameReleased.wait(lock);
+                continue;
+            }
+
+            frame.pinCount++;
+            frame.referenced = true;
+            // Remember a handle we know is open in case the page has to be written back later
+            frame.fd = fd;
+            page = frame.data;
+            hit = true;
+            hitCounter++;
+            return SUCCESS;
+        }
+
+        // Otherwise find a frame to hold it
+        RC rc = getVictimFrame(lock, true, frameNum);
+        if (rc)
+            return rc;
+
+        // Writing back the victim releases the latch, so another thread may have brought the page in
+        // or started writing it meanwhile
+        if (!pageTable.count(key) && !isBeingWritten(key))
+            break;
+    }
+
+    Frame &frame = frames[frameNum];
+    frame.key = key;
+    frame.fd = fd;
+    frame.pinCount = 1;
+    frame.dirty = false;
+    frame.referenced = true;
+    frame.used = true;
+    pageTable[key] = frameNum;
+
+    if (load)
+    {
+        // Read the page without the latch. Other threads wanting it wait for io to be cleared
+        frame.io = true;
+        lock.unlock();
+        bool read = pread(fd, frame.data, PAGE_SIZE, (off_t) PAGE_SIZE * pageNum) == PAGE_SIZE;
+        lock.lock();
+        frame.io = false;
+        frameReleased.notify_all();
+
+        if (!read)
+        {
+            releaseFrame(frameNum);
+            return FH_READ_FAILED;
+        }
+    }
+
+    page = frame.data;
+    hit = false;
+    missCounter++;
+    return SUCCESS;
+}
+
+
+RC BufferManager::unpinPage(FileID file, PageNum pageNum, bool dirty)
+{
+    lock_guard<mutex> guard(latch);
+    PageKey key = {file, pageNum};
+    auto entry = pageTable.find(key);
+    if (entry == pageTable.end())
+        return FH_PAGE_DN_EXIST;
+
+    Frame &frame = frames[entry->second];
+    if (frame.pinCount > 0 && --frame.pinCount == 0)
+        frameReleased.notify_all();
+    frame.dirty = frame.dirty || dirty;
+    return SUCCESS;
+}
+
+
+RC BufferManager::flushPage(FileID file, PageNum pageNum)
+{
+    unique_lock<mutex> lock(latch);
+    PageKey key = {file, pageNum};
+    auto entry = pageTable.find(key);
+    if (entry == pageTable.end())
+        return SUCCESS;
+
+    return writeBack(lock, entry->second);
+}
+
+
+RC BufferManager::loadPages(int fd, FileID file, PageNum pageNum, unsigned count)
+{
+    unique_lock<mutex> lock(latch);
+
+    // Find a frame for each page that is missing. It goes into the page table right away, pinned so it isn't
+    // picked twice and marked as doing I/O so other threads wanting the page wait for the read
+    vector<unsigned> frameNums;
+    vector<IORequest> requests;
+    for (PageNum p = pageNum; p < pageNum + count; p++)
+    {
+        PageKey key = {file, p};
+        if (pageTable.count(key) || isBeingWritten(key))
+            continue;
+
+        // Load as many pages as there are frames for. The frames reserved so far are busy until we read them,
+        // so don't wait for busy frames to become free
+        unsigned frameNum;
+        if (getVictimFrame(lock, false, frameNum))
+            break;
+        // Writing back the victim releases the latch, so another thread may have brought the page in
+        // or started writing it meanwhile
+        if (pageTable.count(key) || isBeingWritten(key))
+            continue;
+
+        Frame &frame = frames[frameNum];
+        frame.key = key;
+        frame.fd = fd;
+        frame.pinCount = 1;
+        frame.dirty = false;
+        frame.referenced = true;
+        frame.used = true;
+        frame.io = true;
+        pageTable[key] = frameNum;
+        frameNums.push_back(frameNum);
+        requests.push_back({fd, p, 1, frame.data, false, false, SUCCESS});
+    }
+
+    if (requests.empty())
+        return SUCCESS;
+
+    lock.unlock();
+    RC rc = AsyncIOManager::instance()->execute(requests.data(), requests.size());
+    lock.lock();
+
+    for (unsigned i = 0; i < frameNums.size(); i++)
+    {
+        Frame &frame = frames[frameNums[i]];
+        frame.io = false;
+        frame.pinCount = 0;
+        if (requests[i].rc)
+            releaseFrame(frameNums[i]);
+    }
+    frameReleased.notify_all();
+    return rc;
+}
+
+
+RC BufferManager::writePages(int fd, FileID file, PageNum pageNum, unsigned count, const byte *data)
+{
+    unique_lock<mutex> lock(latch);
+
+    // Nobody may read the pages in or pin them again until the write is done, otherwise the old contents could be
+    // cached as clean, and readers could keep the write waiting forever
+    PageRange range = {file, pageNum, count};
+    writing.push_back(range);
+
+    // Wait until nobody is using the cached copies of the pages. Frames are only marked once all of them are free,
+    // so we never hold some of them while waiting for the others
+    vector<unsigned> frameNums;
+    while (true)
+    {
+        frameNums.clear();
+        bool busy = false;
+        for (unsigned i = 0; i < count && !busy; i++)
+        {
+            auto entry = pageTable.find({file, pageNum + i});
+            if (entry == pageTable.end())
+                continue;
+            Frame &frame = frames[entry->second];
+            busy = frame.pinCount > 0 || frame.io;
+            frameNums.push_back(entry->second);
+        }
+        if (!busy)
+            break;
+        frameReleased.wait(lock);
+    }
+
+    // Cached copies get the new contents, but stay dirty until the write has succeeded so a failed one isn't lost.
+    // They are marked as doing I/O meanwhile so nobody changes them before they are marked clean
+    for (unsigned i = 0; i < frameNums.size(); i++)
+    {
+        Frame &frame = frames[frameNums[i]];
+        memcpy(frame.data, data + (size_t) (frame.key.pageNum - pageNum) * PAGE_SIZE, PAGE_SIZE);
+        // The write may fail, leaving the page dirty, so it needs a descriptor we know is open
+        frame.fd = fd;
+        frame.dirty = true;
+        frame.io = true;
+    }
+
+    // The pages are consecutive in data, so they go out as a single request
+    lock.unlock();
+    IORequest request = {fd, pageNum, count, (byte*) data, true, false, SUCCESS};
+    RC rc = AsyncIOManager::instance()->execute(&request, 1);
+    lock.lock();
+
+    for (unsigned i = 0; i < writing.size(); i++)
+    {
+        if (writing[i].file == file && writing[i].first == pageNum && writing[i].count == count)
+        {
+            writing.erase(writing.begin() + i);
+            break;
+        }
+    }
+    for (unsigned i = 0; i < frameNums.size(); i++)
+    {
+        Frame &frame = frames[frameNums[i]];
+        frame.io = false;
+        if (rc == SUCCESS)
+            frame.dirty = false;
+    }
+    frameReleased.notify_all();
+    return rc;
+}
+
+
+RC BufferManager::flushFile(FileID file)
+{
+    unique_lock<mutex> lock(latch);
+    vector<unsigned> frameNums;
+    for (unsigned i = 0; i < frames.size(); i++)
+    {
+        Frame &frame = frames[i];
+        if (frame.used && frame.dirty && frame.key.file == file)
+            frameNums.push_back(i);
+    }
+    return writeBack(lock, frameNums);
+}
+
+
+void BufferManager::dropFile(FileID file)
+{
+    unique_lock<mutex> lock(latch);
+    // Frames still being read or written can't be reused yet
+    frameReleased.wait(lock, [this, &file] {
+        for (unsigned i = 0; i < frames.size(); i++)
+        {
+            if (frames[i].io && frames[i].key.file == file)
+                return false;
+        }
+        return true;
+    });
+
+    for (unsigned i = 0; i < frames.size(); i++)
+    {
+        Frame &frame = frames[i];
+        if (frame.used && frame.key.file == file)
+            releaseFrame(i);
+    }
+}
+
+
+RC BufferManager::flushAll()
+{
+    unique_lock<mutex> lock(latch);
+    vector<unsigned> frameNums;
+    for (unsigned i = 0; i < frames.size(); i++)
+    {
+        if (frames[i].used && frames[i].dirty)
+            frameNums.push_back(i);
+    }
+    return writeBack(lock, frameNums);
+}
+
+
+RC BufferManager::collectCounterValues(unsigned &hitCount, unsigned &missCount)
+{
+    lock_guard<mutex> guard(latch);
+    hitCount  = hitCounter;
+    missCount = missCounter;
+    return SUCCESS;
+}
+
+// Private helper methods ///////////////////////////////////////////////////////////////////
+
+void BufferManager::allocateFrames(unsigned n)
+{
+    free(pool);
+    pool = (byte*) malloc(n * PAGE_SIZE);
+
+    frames.assign(n, Frame());
+    for (unsigned i = 0; i < n; i++)
+    {
+        frames[i].fd = NO_FD;
+        frames[i].pinCount = 0;
+        frames[i].dirty = false;
+        frames[i].referenced = false;
+        frames[i].used = false;
+        frames[i].io = false;
+        frames[i].data = pool + i * PAGE_SIZE;
+    }
+
+    pageTable.clear();
+    clockHand = 0;
+}
+
+// Sweep the clock hand until we find an unpinned frame whose reference bit is clear.
+// Writing back a dirty victim releases the latch. If every frame is in use but some are only busy with I/O,
+// wait for them when asked to, otherwise fail
+RC BufferManager::getVictimFrame(unique_lock<mutex> &lock, bool wait, unsigned &frameNum)
+{
+    while (true)
+    {
+        bool busy = false;
+
+        // Two full sweeps are enough to clear every reference bit
+        for (unsigned i = 0; i < 2 * frames.size(); i++)
+        {
+            Frame &frame = frames[clockHand];
+            unsigned current = clockHand;
+            clockHand = (clockHand + 1) % frames.size();
+
+            if (!frame.used)
+            {
+                frameNum = current;
+                return SUCCESS;
+            }
+            if (frame.io)
+            {
+                busy = true;
+                continue;
+            }
+            if (frame.pinCount > 0)
+                continue;
+            if (frame.referenced)
+            {
+                frame.referenced = false;
+                continue;
+            }
+
+            // Evict the page, writing it back first if needed
+            RC rc = writeBack(lock, current);
+            if (rc)
+                return rc;
+            // Someone may have started using the page while the latch was released
+            if (frame.pinCount > 0 || frame.dirty)
+                continue;
+            if (frame.used)
+                releaseFrame(current);
+            frameNum = current;
+            return SUCCESS;
+        }
+
+        // Every frame is pinned
+        if (!busy || !wait)
+            return FH_NO_FREE_FRAME;
+
+        // Frames being read or written become victims once they are done
+        frameReleased.wait(lock);
+    }
+}
+
+// Write a dirty page back to its file. The latch is released during the write, with the frame marked
+// as doing I/O so no other thread uses it meanwhile
+RC BufferManager::writeBack(unique_lock<mutex> &lock, unsigned frameNum)
+{
+    // Let whoever is using the page finish with it first. The pool may be resized meanwhile, which writes back everything
+    frameReleased.wait(lock, [this, frameNum] {
+        return frameNum >= frames.size() || (frames[frameNum].pinCount == 0 && !frames[frameNum].io);
+    });
+    if (frameNum >= frames.size())
+        return SUCCESS;
+
+    Frame &frame = frames[frameNum];
+    if (!frame.used || !frame.dirty)
+        return SUCCESS;
+
+    frame.io = true;
+    int fd = frame.fd;
+    PageNum pageNum = frame.key.pageNum;
+    lock.unlock();
+    // Write the page at its offset in the file
+    bool written = pwrite(fd, frame.data, PAGE_SIZE, (off_t) PAGE_SIZE * pageNum) == PAGE_SIZE;
+    lock.lock();
+    frame.io = false;
+    frameReleased.notify_all();
+
+    if (!written)
+        return FH_WRITE_FAILED;
+
+    frame.dirty = false;
+    return SUCCESS;
+}
+
+// Write back several dirty frames, all of them in flight at once. Like writing back a single frame, the latch is
+// released during the writes
+RC BufferManager::writeBack(unique_lock<mutex> &lock, const vector<unsigned> &frameNums)
+{
+    // Let whoever is using the pages finish with them first. None are marked before all of them are free
+    frameReleased.wait(lock, [this, &frameNums] {
+        for (unsigned i = 0; i < frameNums.size(); i++)
+        {
+            if (frameNums[i] < frames.size() && (frames[frameNums[i]].pinCount > 0 || frames[frameNums[i]].io))
+                return false;
+        }
+        return true;
+    });
+
+    // Some pages may have been written back or evicted meanwhile, or the whole pool resized
+    vector<unsigned> writing;
+    vector<IORequest> requests;
+    for (unsigned i = 0; i < frameNums.size(); i++)
+    {
+        if (frameNums[i] >= frames.size())
+            continue;
+        Frame &frame = frames[frameNums[i]];
+        if (!frame.used || !frame.dirty)
+            continue;
+        frame.io = true;
+        writing.push_back(frameNums[i]);
+        requests.push_back({frame.fd, frame.key.pageNum, 1, frame.data, true, false, SUCCESS});
+    }
+
+    if (requests.empty())
+        return SUCCESS;
+
+    lock.unlock();
+    RC rc = AsyncIOManager::instance()->execute(requests.data(), requests.size());
+    lock.lock();
+
+    for (unsigned i = 0; i < writing.size(); i++)
+    {
+        Frame &frame = frames[writing[i]];
+        frame.io = false;
+        if (requests[i].rc == SUCCESS)
+            frame.dirty = false;
+    }
+    frameReleased.notify_all();
+    return rc;
+}
+
+void BufferManager::releaseFrame(unsigned frameNum)
+{
+    Frame &frame = frames[frameNum];
+    pageTable.erase(frame.key);
+    frame.fd = NO_FD;
+    frame.pinCount = 0;
+    frame.dirty = false;
+    frame.referenced = false;
+    frame.used = false;
+    frame.io = false;
+}
+
+// Whether writePages() is writing the page with the latch released
+bool BufferManager::isBeingWritten(const PageKey &key)
+{
+    for (unsigned i = 0; i < writing.size(); i++)
+    {
+        const PageRange &range = writing[i];
+        if (range.file == key.file && key.pageNum >= range.first && key.pageNum - range.first < range.count)
+            return true;
+    }
+    return false;
+}
+
+void BufferManager::flushAtExit()
+{
+    if (_bp_manager)
+        _bp_manager->flushAll();
+}
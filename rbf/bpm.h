@@ -0,0 +1,121 @@
+#ifndef _bpm_h_
+#define _bpm_h_
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "pfm.h"
+
+// Number of frames in the pool unless changed with setNumberOfFrames()
+#define BPM_DEFAULT_FRAMES 256
+
+using namespace std;
+
+// Identifies a page in the pool: the file it belongs to and its page number
+typedef struct PageKey
+{
+    FileID file;
+    PageNum pageNum;
+
+    bool operator==(const PageKey &that) const
+    {
+        return file == that.file && pageNum == that.pageNum;
+    }
+} PageKey;
+
+struct PageKeyHash
+{
+    size_t operator()(const PageKey &k) const
+    {
+        size_t h = FileIDHash()(k.file);
+        h ^= hash<unsigned>()(k.pageNum) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+// A slot of the pool holding one page
+typedef struct Frame
+{
+    PageKey key;
+    int fd;              // File descriptor used to write the page back. Always an open file while dirty
+    unsigned pinCount;
+    bool dirty;
+    bool referenced;     // CLOCK reference bit
+    bool used;
+    bool io;             // Being read or written with the latch released. Nobody else may use the frame until this is cleared
+    byte *data;
+} Frame;
+
+// Pages of a file being written by writePages() with the latch released
+typedef struct PageRange
+{
+    FileID file;
+    PageNum first;
+    unsigned count;
+} PageRange;
+
+// Process-wide cache of pages shared by every FileHandle.
+// Pages are keyed by file identity, so several handles on the same file see the same frames.
+// Writes are kept in memory until the page is evicted or its file is closed.
+// Replacement uses the CLOCK algorithm over unpinned frames.
+// All methods are safe to call from several threads; a pinned page is never evicted.
+// Pages are read and written back without holding the latch, so threads missing on different pages do their I/O at the same time.
+class BufferManager
+{
+public:
+    static BufferManager* instance();                                   // Access to the _bp_manager instance
+
+    RC setNumberOfFrames(unsigned frames);                              // Resize the pool, writing back dirty pages first
+    unsigned getNumberOfFrames();
+
+    // Pin a page into a frame and return a pointer to it. If load is false the page is not read
+    // from disk on a miss because the caller is going to overwrite all of it.
+    RC pinPage(int fd, FileID file, PageNum pageNum, bool load, byte *&page, bool &hit);
+    RC unpinPage(FileID file, PageNum pageNum, bool dirty);             // Release a pinned page, marking it dirty if modified
+    RC flushPage(FileID file, PageNum pageNum);                         // Write back one page if dirty
+
+    // Read count pages starting at pageNum into the pool, all of them in flight at once.
+    // Pages that are already in the pool are left alone.
+    RC loadPages(int fd, FileID file, PageNum pageNum, unsigned count);
+    // Write count pages from data to the file starting at pageNum with a single request.
+    // Copies of the pages in the pool are updated.
+    RC writePages(int fd, FileID file, PageNum pageNum, unsigned count, const byte *data);
+
+    RC flushFile(FileID file);                                          // Write back every dirty page of a file
+    void dropFile(FileID file);                                         // Forget every page of a file without writing it back
+    RC flushAll();                                                      // Write back every dirty page
+
+    RC collectCounterValues(unsigned &hitCount, unsigned &missCount);   // Put the pool-wide counter values into variables
+
+protected:
+    BufferManager();                                                    // Constructor
+    ~BufferManager();                                                   // Destructor
+
+private:
+    static BufferManager *_bp_manager;
+
+    vector<Frame> frames;
+    byte *pool;
+    unordered_map<PageKey, unsigned, PageKeyHash> pageTable;
+    unsigned clockHand;
+    mutex latch;
+    condition_variable frameReleased;   // Signalled when a frame finishes its I/O or is unpinned, or writePages() is done
+    vector<PageRange> writing;          // Pages that mustn't be pinned or read in until their write is done
+
+    unsigned hitCounter;
+    unsigned missCounter;
+
+    // Private helper methods
+    void allocateFrames(unsigned n);
+    RC getVictimFrame(unique_lock<mutex> &lock, bool wait, unsigned &frameNum);
+    RC writeBack(unique_lock<mutex> &lock, unsigned frameNum);
+    RC writeBack(unique_lock<mutex> &lock, const vector<unsigned> &frameNums);
+    void releaseFrame(unsigned frameNum);
+    bool isBeingWritten(const PageKey &key);
+
+    static void flushAtExit();
+};
+
+#endif
@@ -1,10 +1,21 @@
 #include <cstdio>
+#include <cstring>
 #include <string>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include "pfm.h"
+#include "bpm.h"
+
+// Several threads may read through the same handle at once, so its counters are updated atomically
+static inline void increment(unsigned &counter, unsigned n = 1)
+{
+    __atomic_fetch_add(&counter, n, __ATOMIC_RELAXED);
+}
 
 PagedFileManager* PagedFileManager::_pf_manager = NULL;
 
@@ -33,45 +44,85 @@ RC PagedFileManager::createFile(const string &fileName)
     if (fileExists(fileName))
         return PFM_FILE_EXISTS;
 
-    // Attempt to open the file for writing
-    FILE *pFile = fopen(fileName.c_str(), "wb");
+    // Attempt to create the file
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
     // Return an error if we fail
-    if (pFile == NULL)
+    if (fd < 0)
         return PFM_OPEN_FAILED;
 
-    fclose (pFile);
+    close(fd);
+
+    // A new file may reuse the identity of a destroyed one, make sure no stale state survives
+    FileID id;
+    if (getFileID(fileName, id))
+        forgetFile(id);
+
     return SUCCESS;
 }
 
 
 RC PagedFileManager::destroyFile(const string &fileName)
 {
+    FileID id;
+    bool found = getFileID(fileName, id);
+
     // If file cannot be successfully removed, error
     if (remove(fileName.c_str()) != 0)
         return PFM_REMOVE_FAILED;
 
+    // Cached pages and the page count of the file are meaningless once it is gone
+    if (found)
+        forgetFile(id);
+
     return SUCCESS;
 }
 
 
-RC PagedFileManager::openFile(const string &fileName, FileHandle &fileHandle)
+RC PagedFileManager::openFile(const string &fileName, FileHandle &fileHandle, FileMode mode)
 {
     // If this handle already has an open file, error
-    if (fileHandle.getfd() != NULL)
+    if (fileHandle.getfd() != NO_FD)
         return PFM_HANDLE_IN_USE;
 
     // If the file doesn't exist, error
     if (!fileExists(fileName.c_str()))
         return PFM_FILE_DN_EXIST;
 
-    // Open the file for reading/writing in binary mode
-    FILE *pFile;
-    pFile = fopen(fileName.c_str(), "rb+");
+    // Open the file for reading/writing, or only reading if it is to be mapped. All page I/O is positional so there is no stdio buffering
+    int fd = open(fileName.c_str(), mode == FH_MAPPED ? O_RDONLY : O_RDWR);
     // If we fail, error
-    if (pFile == NULL)
+    if (fd < 0)
+        return PFM_OPEN_FAILED;
+
+    fileHandle.setfd(fd);
+    fileHandle.resetReadAhead();
+
+    // Pages are cached by file identity so every handle on this file shares them
+    struct stat sb;
+    if (fstat(fd, &sb) != 0)
+    {
+        close(fd);
+        fileHandle.setfd(NO_FD);
         return PFM_OPEN_FAILED;
+    }
+    fileHandle._id.dev = sb.st_dev;
+    fileHandle._id.ino = sb.st_ino;
+
+    // Only the first handle on a file reads its length, later ones share the count kept in memory
+    FileInfo &info = files[fileHandle._id];
+    if (info.openCount == 0)
+    {
+        info.numPages = sb.st_size / PAGE_SIZE;
+        info.freeSpace.clear();
+    }
+    info.openCount++;
+    fileHandle._info = &info;
 
-    fileHandle.setfd(pFile);
+    if (mode == FH_MAPPED && fileHandle.mapFile())
+    {
+        closeFile(fileHandle);
+        return PFM_OPEN_FAILED;
+    }
 
     return SUCCESS;
 }
@@ -79,16 +130,26 @@ RC PagedFileManager::openFile(const string &fileName, FileHandle &fileHandle)
 
 RC PagedFileManager::closeFile(FileHandle &fileHandle)
 {
-    FILE *pFile = fileHandle.getfd();
+    int fd = fileHandle.getfd();
 
     // If not an open file, error
-    if (pFile == NULL)
-        return 1;
+    if (fd == NO_FD)
+        return PFM_FILE_NOT_OPEN;
+
+    // Write back cached pages, then close the file
+    BufferManager::instance()->flushFile(fileHandle._id);
+    fileHandle.unmapFile();
+    close(fd);
 
-    // Flush and close the file
-    fclose(pFile);
+    FileInfo &info = *fileHandle._info;
+    if (info.openCount > 0)
+        info.openCount--;
+    fileHandle._info = NULL;
+    fileHandle.setfd(NO_FD);
 
-    fileHandle.setfd(NULL);
+    // The last handle on a destroyed file cleans up after it
+    if (info.openCount == 0 && info.destroyed)
+        forgetFile(fileHandle._id);
 
     return SUCCESS;
 }
@@ -101,14 +162,53 @@ bool PagedFileManager::fileExists(const string &fileName)
     return stat(fileName.c_str(), &sb) == 0;
 }
 
+// Drop the cached pages and page count of a file. If handles are still open on it they keep using both,
+// and closeFile drops them once the last handle is closed
+void PagedFileManager::forgetFile(const FileID &id)
+{
+    auto entry = files.find(id);
+    if (entry != files.end() && entry->second.openCount > 0)
+    {
+        entry->second.destroyed = true;
+        return;
+    }
+
+    BufferManager::instance()->dropFile(id);
+    files.erase(id);
+}
+
+// Get the identity of a file, returns false if it doesn't exist
+bool PagedFileManager::getFileID(const string &fileName, FileID &id)
+{
+    struct stat sb;
+    if (stat(fileName.c_str(), &sb) != 0)
+        return false;
+    id.dev = sb.st_dev;
+    id.ino = sb.st_ino;
+    return true;
+}
+
 
 FileHandle::FileHandle()
 {
     readPageCounter = 0;
     writePageCounter = 0;
     appendPageCounter = 0;
-
-    _fd = NULL;
+    bufferHitCounter = 0;
+    bufferMissCounter = 0;
+    statAvoidedCounter = 0;
+    sequentialRunCounter = 0;
+
+    _fd = NO_FD;
+    _id.dev = 0;
+    _id.ino = 0;
+    _info = NULL;
+    _bp_manager = BufferManager::instance();
+    resetReadAhead();
+
+    _map = NULL;
+    _mappedPages = 0;
+    _mappedWrites = 0;
 }
 
 
@@ -123,85 +223,313 @@ RC FileHandle::readPage(PageNum pageNum, void *data)
     if (getNumberOfPages() < pageNum)
         return FH_PAGE_DN_EXIST;
 
-    // Try to seek to the specified page
-    if (fseek(_fd, PAGE_SIZE * pageNum, SEEK_SET))
-        return FH_SEEK_FAILED;
+    // A mapped file is read straight from the mapping
+    if (_map != NULL)
+    {
+        void *page;
+        RC rc = viewPage(pageNum, NULL, page);
+        if (rc)
+            return rc;
+        memcpy(data, page, PAGE_SIZE);
+        increment(readPageCounter);
+        return SUCCESS;
+    }
 
-    // Try to read the specified page
-    if (fread(data, 1, PAGE_SIZE, _fd) != PAGE_SIZE)
-        return FH_READ_FAILED;
+    readAhead(pageNum);
+
+    // Get the page from the buffer pool, which reads it from disk on a miss
+    byte *page;
+    bool hit;
+    RC rc = _bp_manager->pinPage(_fd, _id, pageNum, true, page, hit);
+    if (rc)
+        return rc;
 
-    readPageCounter++;
+    memcpy(data, page, PAGE_SIZE);
+    _bp_manager->unpinPage(_id, pageNum, false);
+
+    if (hit)
+        increment(bufferHitCounter);
+    else
+        increment(bufferMissCounter);
+    increment(readPageCounter);
     return SUCCESS;
 }
 
 
 RC FileHandle::writePage(PageNum pageNum, const void *data)
 {
+    if (_map != NULL)
+        return FH_READ_ONLY;
+
     // Check if the page exists
-    if (getNumberOfPages() < pageNum)
+    unsigned numPages = getNumberOfPages();
+    if (numPages < pageNum)
         return FH_PAGE_DN_EXIST;
 
-    // Seek to the start of the page
-    if (fseek(_fd, PAGE_SIZE * pageNum, SEEK_SET))
-        return FH_SEEK_FAILED;
+    // The whole page is overwritten, so there is no need to read it in on a miss
+    byte *page;
+    bool hit;
+    RC rc = _bp_manager->pinPage(_fd, _id, pageNum, false, page, hit);
+    if (rc)
+        return rc;
+
+    memcpy(page, data, PAGE_SIZE);
+    _bp_manager->unpinPage(_id, pageNum, true);
 
-    // Write the page
-    if (fwrite(data, 1, PAGE_SIZE, _fd) == PAGE_SIZE)
+    // Writing just past the end grows the file like an append does
+    if (pageNum == numPages)
     {
-        // Immediately commit changes to disk
-        fflush(_fd);
-        writePageCounter++;
-        return SUCCESS;
+        rc = _bp_manager->flushPage(_id, pageNum);
+        if (rc)
+            return rc;
+        _info->numPages++;
     }
-    
-    return FH_WRITE_FAILED;
+
+    _info->writeCount++;
+    increment(writePageCounter);
+    return SUCCESS;
 }
 
 
 RC FileHandle::appendPage(const void *data)
 {
-    // Seek to the end of the file
-    if (fseek(_fd, 0, SEEK_END))
-        return FH_SEEK_FAILED;
+    if (_map != NULL)
+        return FH_READ_ONLY;
+
+    // Write the new page at the end of the file. Appends go straight to disk so the file length always matches the page count
+    PageNum pageNum = getNumberOfPages();
+    if (pwrite(_fd, data, PAGE_SIZE, (off_t) PAGE_SIZE * pageNum) != PAGE_SIZE)
+        return FH_WRITE_FAILED;
+    _info->numPages++;
+
+    // Keep a copy in the buffer pool since new pages are usually read again soon
+    byte *page;
+    bool hit;
+    if (_bp_manager->pinPage(_fd, _id, pageNum, false, page, hit) == SUCCESS)
+    {
+        memcpy(page, data, PAGE_SIZE);
+        _bp_manager->unpinPage(_id, pageNum, false);
+    }
+
+    _info->writeCount++;
+    increment(appendPageCounter);
+    return SUCCESS;
+}
 
-    // Write the new page
-    if (fwrite(data, 1, PAGE_SIZE, _fd) == PAGE_SIZE)
+
+RC FileHandle::writePages(PageNum pageNum, const void *data, unsigned count)
+{
+    if (_map != NULL)
+        return FH_READ_ONLY;
+
+    // The pages can start anywhere up to the end of the file and grow it
+    unsigned numPages = getNumberOfPages();
+    if (numPages < pageNum)
+        return FH_PAGE_DN_EXIST;
+
+    RC rc = _bp_manager->writePages(_fd, _id, pageNum, count, (const byte*) data);
+    if (rc)
+        return rc;
+
+    if (pageNum + count > numPages)
+        _info->numPages = pageNum + count;
+    _info->writeCount += count;
+    increment(writePageCounter, count);
+    return SUCCESS;
+}
+
+
+RC FileHandle::prefetchPages(PageNum pageNum, unsigned count)
+{
+    unsigned numPages = getNumberOfPages();
+    if (pageNum >= numPages)
+        return SUCCESS;
+    if (count > numPages - pageNum)
+        count = numPages - pageNum;
+
+    // Pages of a mapped file don't go through the pool, so let the kernel read them into the mapping
+    if (_map != NULL)
     {
-        fflush(_fd);
-        appendPageCounter++;
+        RC rc = updateMapping();
+        if (rc)
+            return rc;
+        if (pageNum + count > _mappedPages)
+            return SUCCESS;
+        madvise(_map + (size_t) PAGE_SIZE * pageNum, (size_t) PAGE_SIZE * count, MADV_WILLNEED);
         return SUCCESS;
     }
-    return FH_WRITE_FAILED;
+
+    return _bp_manager->loadPages(_fd, _id, pageNum, count);
+}
+
+
+RC FileHandle::viewPage(PageNum pageNum, void *buffer, void *&page)
+{
+    if (_map == NULL)
+    {
+        RC rc = readPage(pageNum, buffer);
+        if (rc)
+            return rc;
+        page = buffer;
+        return SUCCESS;
+    }
+
+    RC rc = updateMapping();
+    if (rc)
+        return rc;
+    if (pageNum >= _mappedPages)
+        return FH_PAGE_DN_EXIST;
+
+    page = _map + (size_t) PAGE_SIZE * pageNum;
+    return SUCCESS;
+}
+
+
+bool FileHandle::isMapped()
+{
+    return _map != NULL;
 }
 
 
 unsigned FileHandle::getNumberOfPages()
 {
-    // Use stat to get the file size
-    struct stat sb;
-    if (fstat(fileno(_fd), &sb) != 0)
-        // On error, return 0
+    // Not an open file
+    if (_info == NULL)
         return 0;
-    // Filesize is always PAGE_SIZE * number of pages
-    return sb.st_size / PAGE_SIZE;
+
+    // The count is read from disk when the file is opened and kept up to date by appends
+    increment(statAvoidedCounter);
+    return _info->numPages;
+}
+
+
+unsigned FileHandle::getFileVersion()
+{
+    // Not an open file
+    if (_info == NULL)
+        return 0;
+
+    // Every handle on the file shares the count
+    return _info->writeCount;
+}
+
+
+vector<unsigned char>* FileHandle::getFreeSpaceSummary()
+{
+    // Not an open file
+    if (_info == NULL)
+        return NULL;
+
+    return &_info->freeSpace;
 }
 
 
 RC FileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount)
 {
-    readPageCount   = readPageCounter;
-    writePageCount  = writePageCounter;
-    appendPageCount = appendPageCounter;
+    readPageCount   = __atomic_load_n(&readPageCounter, __ATOMIC_RELAXED);
+    writePageCount  = __atomic_load_n(&writePageCounter, __ATOMIC_RELAXED);
+    appendPageCount = __atomic_load_n(&appendPageCounter, __ATOMIC_RELAXED);
+    return SUCCESS;
+}
+
+
+RC FileHandle::collectBufferCounterValues(unsigned &hitCount, unsigned &missCount)
+{
+    hitCount  = __atomic_load_n(&bufferHitCounter, __ATOMIC_RELAXED);
+    missCount = __atomic_load_n(&bufferMissCounter, __ATOMIC_RELAXED);
     return SUCCESS;
 }
 
-void FileHandle::setfd(FILE *fd)
+void FileHandle::setfd(int fd)
 {
     _fd = fd;
 }
 
-FILE *FileHandle::getfd()
+int FileHandle::getfd()
 {
     return _fd;
+}
+
+// Called before every page read. While the reads go through the file in order the kernel is told so, which makes it
+// read ahead of us in the background with a window that grows as long as we keep consuming pages.
+// Threads reading through the same handle at once just break each other's runs
+void FileHandle::readAhead(PageNum pageNum)
+{
+    PageNum expected = __atomic_exchange_n(&nextSequentialPage, pageNum + 1, __ATOMIC_RELAXED);
+
+    // Skipping a page (e.g. a free space map) doesn't end a run
+    if (pageNum == expected || pageNum == expected + 1)
+    {
+        if (__atomic_add_fetch(&runLength, 1, __ATOMIC_RELAXED) == FH_SEQUENTIAL_RUN)
+        {
+            posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            increment(sequentialRunCounter);
+        }
+    }
+    else
+    {
+        // Back to the default amount of read ahead once the run is broken
+        if (__atomic_exchange_n(&runLength, 1, __ATOMIC_RELAXED) >= FH_SEQUENTIAL_RUN)
+            posix_fadvise(_fd, 0, 0, POSIX_FADV_NORMAL);
+    }
+}
+
+void FileHandle::resetReadAhead()
+{
+    nextSequentialPage = 0;
+    runLength = 0;
+}
+
+// Set aside FH_MAP_RESERVE bytes of address space and map the file at the start of it.
+// The file is only ever mapped further along as it grows, so pages handed out earlier never move.
+RC FileHandle::mapFile()
+{
+    void *reserved = mmap(NULL, FH_MAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED)
+        return FH_READ_FAILED;
+
+    _map = (char*) reserved;
+    _mappedPages = 0;
+    _mappedWrites = _info->writeCount - 1;
+    return updateMapping();
+}
+
+// Catch up with writes made through other handles on the file since the last call
+RC FileHandle::updateMapping()
+{
+    unsigned version = _info->writeCount;
+    if (_mappedWrites == version)
+        return SUCCESS;
+
+    // Pages written through the buffer pool have to reach the file before the mapping shows them. Every write
+    // counted in version is in the pool by now, so it is flushed too
+    RC rc = _bp_manager->flushFile(_id);
+    if (rc)
+        return rc;
+
+    unsigned numPages = _info->numPages;
+    if (numPages > _mappedPages)
+    {
+        if ((unsigned long long) numPages * PAGE_SIZE > FH_MAP_RESERVE)
+            return FH_READ_FAILED;
+
+        size_t offset = (size_t) PAGE_SIZE * _mappedPages;
+        size_t length = (size_t) PAGE_SIZE * (numPages - _mappedPages);
+        if (mmap(_map + offset, length, PROT_READ, MAP_SHARED | MAP_FIXED, _fd, offset) == MAP_FAILED)
+            return FH_READ_FAILED;
+        _mappedPages = numPages;
+    }
+
+    _mappedWrites = version;
+    return SUCCESS;
+}
+
+void FileHandle::unmapFile()
+{
+    if (_map == NULL)
+        return;
+
+    munmap(_map, FH_MAP_RESERVE);
+    _map = NULL;
+    _mappedPages = 0;
 }
\ No newline at end of file
@@ -14,6 +14,16 @@
 #define FH_SEEK_FAILED    2
 #define FH_READ_FAILED    3
 #define FH_WRITE_FAILED   4
+#define FH_NO_FREE_FRAME  5
+#define FH_READ_ONLY      6
+
+#define NO_FD (-1)        // FileHandle without an open file
+
+// Number of pages read in order before a FileHandle tells the kernel to read ahead of it
+#define FH_SEQUENTIAL_RUN 4
+
+// Address space set aside for the mapping of a file opened with FH_MAPPED, which limits the size of such files
+#define FH_MAP_RESERVE    (1ULL << 40)
 
 typedef unsigned PageNum;
 typedef int RC;
@@ -22,9 +32,49 @@ typedef char byte;
 #define PAGE_SIZE 4096
 #include <string>
 #include <climits>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
 using namespace std;
 
+// Identifies a file independently of the path used to open it
+typedef struct FileID
+{
+    dev_t dev;
+    ino_t ino;
+
+    bool operator==(const FileID &that) const { return dev == that.dev && ino == that.ino; }
+} FileID;
+
+struct FileIDHash
+{
+    size_t operator()(const FileID &id) const
+    {
+        size_t h = hash<unsigned long long>()(id.ino);
+        h ^= hash<unsigned long long>()(id.dev) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+// State kept in memory for each file and shared by every handle open on it
+typedef struct FileInfo
+{
+    unsigned numPages;   // Length of the file in pages, read from disk only when the file is first opened
+    unsigned openCount;  // Number of handles currently open on the file
+    unsigned writeCount; // Pages written through any handle, so cached copies of pages can tell when the file changed
+    bool destroyed;      // Destroyed or recreated while handles were open on it, forgotten once the last one is closed
+    vector<unsigned char> freeSpace;  // Bound on the largest entry of each free space map page of a record based file
+} FileInfo;
+
+// How a FileHandle gets at the pages of its file.
+// FH_READ_WRITE goes through the buffer pool. FH_MAPPED maps the whole file read only and hands out pointers
+// into the mapping with viewPage(), so reads don't copy pages. Writes through a mapped handle fail with FH_READ_ONLY.
+typedef enum { FH_READ_WRITE = 0, FH_MAPPED } FileMode;
+
 class FileHandle;
+class BufferManager;
 
 class PagedFileManager
 {
@@ -33,7 +83,8 @@ public:
 
     RC createFile    (const string &fileName);                          // Create a new file
     RC destroyFile   (const string &fileName);                          // Destroy a file
-    RC openFile      (const string &fileName, FileHandle &fileHandle);  // Open a file
+    RC openFile      (const string &fileName, FileHandle &fileHandle,
+                      FileMode mode = FH_READ_WRITE);                   // Open a file
     RC closeFile     (FileHandle &fileHandle);                          // Close a file
 
 protected:
@@ -43,8 +94,12 @@ protected:
 private:
     static PagedFileManager *_pf_manager;
 
+    unordered_map<FileID, FileInfo, FileIDHash> files;
+
     // Private helper methods
     bool fileExists(const string &fileName);
+    bool getFileID(const string &fileName, FileID &id);
+    void forgetFile(const FileID &id);
 };
 
 
@@ -55,25 +110,57 @@ public:
     unsigned readPageCounter;
     unsigned writePageCounter;
     unsigned appendPageCounter;
-    
+    // variables to keep the counter for buffer pool lookups
+    unsigned bufferHitCounter;
+    unsigned bufferMissCounter;
+    // variable to keep the counter for page counts answered without an fstat
+    unsigned statAvoidedCounter;
+    // variable to keep the counter for runs of sequential reads detected
+    unsigned sequentialRunCounter;
+
     FileHandle();                                                       // Default constructor
     ~FileHandle();                                                      // Destructor
 
     RC readPage(PageNum pageNum, void *data);                           // Get a specific page
     RC writePage(PageNum pageNum, const void *data);                    // Write a specific page
     RC appendPage(const void *data);                                    // Append a specific page
+    RC writePages(PageNum pageNum, const void *data, unsigned count);   // Write count consecutive pages with a single request
+    RC prefetchPages(PageNum pageNum, unsigned count);                  // Read count consecutive pages into the buffer pool, all in flight at once
+
+    // Point page at a page without copying it when the file is mapped, otherwise read it into buffer and point page there.
+    // A page in the mapping must not be modified, and stays valid until the file is closed.
+    RC viewPage(PageNum pageNum, void *buffer, void *&page);
+    bool isMapped();                                                    // Whether the file was opened with FH_MAPPED
     unsigned getNumberOfPages();                                        // Get the number of pages in the file
+    unsigned getFileVersion();                                          // Changes whenever a page of the file is written through any handle
+    vector<unsigned char> *getFreeSpaceSummary();                       // Kept by the record based file manager for every handle on the file
     RC collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount);  // Put the current counter values into variables
+    RC collectBufferCounterValues(unsigned &hitCount, unsigned &missCount);                                 // Put the current buffer pool counter values into variables
 
     // Let PagedFileManager access our private helper methods
     friend class PagedFileManager;
 
 private:
-    FILE *_fd;
+    int _fd;
+    FileID _id;
+    FileInfo *_info;
+    BufferManager *_bp_manager;
+
+    PageNum nextSequentialPage;  // Page that continues the current run of sequential reads
+    unsigned runLength;          // Pages read in the current run
+
+    char *_map;                  // Mapping of the file in FH_MAPPED mode, NULL otherwise
+    unsigned _mappedPages;       // Pages of the file covered by the mapping
+    unsigned _mappedWrites;      // Writes to the file the mapping has caught up with
 
     // Private helper methods
-    void setfd(FILE *fd);
-    FILE *getfd();
+    void setfd(int fd);
+    int getfd();
+    void readAhead(PageNum pageNum);
+    void resetReadAhead();
+    RC mapFile();
+    RC updateMapping();
+    void unmapFile();
 }; 
 
 #endif
@@ -40,14 +40,18 @@ RC RecordBasedFileManager::createFile(const string &fileName)
     void * firstPageData = calloc(PAGE_SIZE, 1);
     if (firstPageData == NULL)
         return RBFM_MALLOC_FAILED;
-    newRecordBasedPage(firstPageData);
 
-    // Adds the first record based page.
+    // Adds the free space map page, which starts out empty, followed by the first record based page.
     FileHandle handle;
     if (_pf_manager->openFile(fileName.c_str(), handle))
         return RBFM_OPEN_FAILED;
     if (handle.appendPage(firstPageData))
         return RBFM_APPEND_FAILED;
+    newRecordBasedPage(firstPageData);
+    if (handle.appendPage(firstPageData))
+        return RBFM_APPEND_FAILED;
+    if (updateFreeSpaceMap(handle, 1, firstPageData))
+        return RBFM_WRITE_FAILED;
     _pf_manager->closeFile(handle);
 
     free(firstPageData);
@@ -60,9 +64,9 @@ RC RecordBasedFileManager::destroyFile(const string &fileName)
     return _pf_manager->destroyFile(fileName);
 }
 
-RC RecordBasedFileManager::openFile(const string &fileName, FileHandle &fileHandle) 
+RC RecordBasedFileManager::openFile(const string &fileName, FileHandle &fileHandle, FileMode mode) 
 {
-    return _pf_manager->openFile(fileName.c_str(), fileHandle);
+    return _pf_manager->openFile(fileName.c_str(), fileHandle, mode);
 }
 
 RC RecordBasedFileManager::closeFile(FileHandle &fileHandle) 
@@ -75,82 +79,102 @@ RC RecordBasedFileManager::insertRecord(FileHandle &fileHandle, const vector<Att
     // Gets the size of the record.
     unsigned recordSize = getRecordSize(recordDescriptor, data);
 
-    // Cycles through pages looking for enough free space for the new entry.
     void *pageData = malloc(PAGE_SIZE);
     if (pageData == NULL)
         return RBFM_MALLOC_FAILED;
-    bool pageFound = false;
-    unsigned i;
-    unsigned numPages = fileHandle.getNumberOfPages();
-    for (i = 0; i < numPages; i++)
-    {
-        if (fileHandle.readPage(i, pageData))
-            return RBFM_READ_FAILED;
 
-        // When we find a page with enough space (accounting also for the size that will be added to the slot directory), we stop the loop.
-        if (getPageFreeSpaceSize(pageData) >= sizeof(SlotDirectoryRecordEntry) + recordSize)
-        {
-            pageFound = true;
-            break;
-        }
-    }
-
-    // If we can't find a page with enough space, we create a new one
-    if(!pageFound)
+    // Gets a page with enough free space for the new entry (accounting also for the size that will be added to the slot directory).
+    PageNum pageNum;
+    bool pageFound;
+    RC rc = getPageForRecord(fileHandle, recordSize, pageData, pageNum, pageFound);
+    if (rc == SUCCESS)
     {
-        newRecordBasedPage(pageData);
+        // Adding the record and writing the page to disk.
+        setRecordOnPage(pageData, pageNum, recordDescriptor, data, recordSize, rid);
+        rc = writeRecordPage(fileHandle, pageNum, pageData, pageFound);
     }
 
-    SlotDirectoryHeader slotHeader = getSlotDirectoryHeader(pageData);
+    free(pageData);
+    return rc;
+}
 
-    // Setting the return RID.
-    rid.pageNum = i;
-    rid.slotNum = getOpenSlot(pageData);
+RC RecordBasedFileManager::insertRecords(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const vector<const void *> &data, vector<RID> &rids)
+{
+    return insertRecordBatch(fileHandle, recordDescriptor, data, rids, false);
+}
 
-    // Adding the new record reference in the slot directory.
-    SlotDirectoryRecordEntry newRecordEntry;
-    newRecordEntry.length = recordSize;
-    newRecordEntry.offset = slotHeader.freeSpaceOffset - recordSize;
-    setSlotDirectoryRecordEntry(pageData, rid.slotNum, newRecordEntry);
+RC RecordBasedFileManager::appendRecords(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const vector<const void *> &data, vector<RID> &rids)
+{
+    return insertRecordBatch(fileHandle, recordDescriptor, data, rids, true);
+}
 
-    // Updating the slot directory header.
-    slotHeader.freeSpaceOffset = newRecordEntry.offset;
-    if (rid.slotNum == slotHeader.recordEntriesNumber)
-        slotHeader.recordEntriesNumber += 1;
-    setSlotDirectoryHeader(pageData, slotHeader);
+RC RecordBasedFileManager::insertRecordBatch(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const vector<const void *> &data, vector<RID> &rids, bool append)
+{
+    rids.resize(data.size());
+    if (data.empty())
+        return SUCCESS;
 
-    // Adding the record data.
-    setRecordAtOffset (pageData, newRecordEntry.offset, recordDescriptor, data);
+    void *pageData = malloc(PAGE_SIZE);
+    if (pageData == NULL)
+        return RBFM_MALLOC_FAILED;
 
-    // Writing the page to disk.
-    if (pageFound)
-    {
-        if (fileHandle.writePage(i, pageData))
-            return RBFM_WRITE_FAILED;
-    }
-    else
+    // The page being filled stays in memory until the next record no longer fits on it.
+    PageNum pageNum = 0;
+    bool pageFound = false;
+    bool pageOpen = false;
+    RC rc = SUCCESS;
+    for (unsigned i = 0; i < data.size(); i++)
     {
-        if (fileHandle.appendPage(pageData))
-            return RBFM_APPEND_FAILED;
+        unsigned recordSize = getRecordSize(recordDescriptor, data[i]);
+
+        if (pageOpen && getPageFreeSpaceSize(pageData) < sizeof(SlotDirectoryRecordEntry) + recordSize)
+        {
+            pageOpen = false;
+            if ((rc = writeRecordPage(fileHandle, pageNum, pageData, pageFound)))
+                break;
+        }
+
+        if (!pageOpen)
+        {
+            if ((rc = getPageForRecord(fileHandle, recordSize, pageData, pageNum, pageFound, append)))
+                break;
+            pageOpen = true;
+        }
+
+        setRecordOnPage(pageData, pageNum, recordDescriptor, data[i], recordSize, rids[i]);
     }
 
+    if (pageOpen && rc == SUCCESS)
+        rc = writeRecordPage(fileHandle, pageNum, pageData, pageFound);
+
     free(pageData);
-    return SUCCESS;
+    return rc;
 }
 
 RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid, void *data) 
 {
-    // Retrieve the specific page
-    void *pageData = malloc(PAGE_SIZE);
-    if (pageData == NULL)
-        return RBFM_MALLOC_FAILED;
-    if (fileHandle.readPage(rid.pageNum, pageData))
+    // Retrieve the specific page. A mapped file hands it out in place, otherwise it is read into a buffer
+    void *buffer = NULL;
+    if (!fileHandle.isMapped())
+    {
+        buffer = malloc(PAGE_SIZE);
+        if (buffer == NULL)
+            return RBFM_MALLOC_FAILED;
+    }
+    void *pageData;
+    if (fileHandle.viewPage(rid.pageNum, buffer, pageData))
+    {
+        free(buffer);
         return RBFM_READ_FAILED;
+    }
 
     // Checks if the specific slot id exists in the page
     SlotDirectoryHeader slotHeader = getSlotDirectoryHeader(pageData);
     if(slotHeader.recordEntriesNumber <= rid.slotNum)
+    {
+        free(buffer);
         return RBFM_SLOT_DN_EXIST;
+    }
 
     // Gets the slot directory record entry data
     SlotDirectoryRecordEntry recordEntry = getSlotDirectoryRecordEntry(pageData, rid.slotNum);
@@ -160,11 +184,11 @@ RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const vector<Attri
     {
         // Error to read a deleted record
         case DEAD:
-            free(pageData);
+            free(buffer);
             return RBFM_READ_AFTER_DEL;
         // Get the forwarding address from the record entry and recurse
         case MOVED:
-            free(pageData);
+            free(buffer);
             RID newRid;
             newRid.pageNum = recordEntry.length;
             newRid.slotNum = -recordEntry.offset;
@@ -173,7 +197,7 @@ RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const vector<Attri
         case VALID:
             int32_t offset = recordEntry.offset;
             getRecordAtOffset(pageData, offset, recordDescriptor, data);
-            free(pageData);
+            free(buffer);
             return SUCCESS;
     }
     // Not possible to reach this point, but compiler doesn't know that
@@ -223,6 +247,8 @@ RC RecordBasedFileManager::deleteRecord(FileHandle &fileHandle, const vector<Att
     
     // Once we've deleted the page(s), write changes to disk
     RC rc = fileHandle.writePage(rid.pageNum, pageData);
+    if (rc == SUCCESS)
+        rc = updateFreeSpaceMap(fileHandle, rid.pageNum, pageData);
     free(pageData);
     return rc;
 }
@@ -287,6 +313,8 @@ RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, const vector<Att
         setSlotDirectoryRecordEntry(pageData, rid.slotNum, recordEntry);
         reorganizePage(pageData);
         RC rc = fileHandle.writePage(rid.pageNum, pageData);
+        if (rc == SUCCESS)
+            rc = updateFreeSpaceMap(fileHandle, rid.pageNum, pageData);
         free(pageData);
         return rc;
     }
@@ -332,6 +360,8 @@ RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, const vector<Att
         }
     }
     RC rc = fileHandle.writePage(rid.pageNum, pageData);
+    if (rc == SUCCESS)
+        rc = updateFreeSpaceMap(fileHandle, rid.pageNum, pageData);
     free(pageData);
     return rc;
 }
@@ -402,19 +432,28 @@ RC RecordBasedFileManager::printRecord(const vector<Attribute> &recordDescriptor
 
 RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid, const string &attributeName, void *data)
 {
-    char *pageData = (char*)malloc(PAGE_SIZE);
-    if (pageData == NULL)
-        return RBFM_MALLOC_FAILED;
-    if (fileHandle.readPage(rid.pageNum, pageData) != SUCCESS)
+    // A mapped file hands out the page in place, otherwise it is read into a buffer
+    void *buffer = NULL;
+    if (!fileHandle.isMapped())
     {
-        free(pageData);
+        buffer = malloc(PAGE_SIZE);
+        if (buffer == NULL)
+            return RBFM_MALLOC_FAILED;
+    }
+    void *pageData;
+    if (fileHandle.viewPage(rid.pageNum, buffer, pageData) != SUCCESS)
+    {
+        free(buffer);
         return RBFM_READ_FAILED;
     }
     // Get record header, recurse if forwarded
     // Checks if the specific slot id exists in the page
     SlotDirectoryHeader slotHeader = getSlotDirectoryHeader(pageData);
     if(slotHeader.recordEntriesNumber < rid.slotNum)
+    {
+        free(buffer);
         return RBFM_SLOT_DN_EXIST;
+    }
 
     // Gets the slot directory record entry data
     SlotDirectoryRecordEntry recordEntry = getSlotDirectoryRecordEntry(pageData, rid.slotNum);
@@ -424,11 +463,11 @@ RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, const vector<At
     {
         // Error to get attribute of a deleted record
         case DEAD:
-            free(pageData);
+            free(buffer);
             return RBFM_READ_AFTER_DEL;
         // Get the forwarding address from the record entry and recurse
         case MOVED:
-            free(pageData);
+            free(buffer);
             RID newRid;
             newRid.pageNum = recordEntry.length;
             newRid.slotNum = -recordEntry.offset;
@@ -444,11 +483,14 @@ RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, const vector<At
     auto iterPos = find_if(recordDescriptor.begin(), recordDescriptor.end(), pred);
     unsigned index = distance(recordDescriptor.begin(), iterPos);
     if (index == recordDescriptor.size())
+    {
+        free(buffer);
         return RBFM_NO_SUCH_ATTR;
+    }
     AttrType type = recordDescriptor[index].type;
     // Write attribute to data
     getAttributeFromRecord(pageData, offset, index, type, data);
-    free(pageData);
+    free(buffer);
     return SUCCESS;
 }
 
@@ -465,7 +507,7 @@ RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, const vector<At
 }
 
 RBFM_ScanIterator::RBFM_ScanIterator()
-: currPage(0), currSlot(0), totalPage(0), totalSlot(0)
+: currPage(0), currSlot(0), totalPage(0), totalSlot(0), pageData(NULL), page(NULL), pageVersion(0), conditionData(NULL)
 {
     rbfm = RecordBasedFileManager::instance();
 }
@@ -473,6 +515,10 @@ RBFM_ScanIterator::RBFM_ScanIterator()
 RC RBFM_ScanIterator::close()
 {
     free(pageData);
+    free(conditionData);
+    pageData = NULL;
+    page = NULL;
+    conditionData = NULL;
     return SUCCESS;
 }
 
@@ -484,13 +530,15 @@ RC RBFM_ScanIterator::scanInit(FileHandle &fh,
         const void *v, 
         const vector<string> &an)
 {
-    // Start at page 0 slot 0
-    currPage = 0;
+    // Start at the first record based page (page 0 holds the free space map), slot 0
+    currPage = 1;
     currSlot = 0;
     totalPage = 0;
     totalSlot = 0;
-    // Keep a buffer to hold the current page
+    prefetchEnd = 0;
+    // Keep a buffer to hold the current page, and one for the condition attribute of each record
     pageData = malloc(PAGE_SIZE);
+    conditionData = malloc(PAGE_SIZE);
 
     // Store the variables passed in to
     fileHandle = fh;
@@ -502,32 +550,36 @@ RC RBFM_ScanIterator::scanInit(FileHandle &fh,
 
     skipList.clear();
 
-    // Get total number of pages
-    totalPage = fh.getNumberOfPages();
-    if (totalPage > 0)
+    // Find where each projected attribute is in the record descriptor once, rather than for every record
+    projection.clear();
+    for (const string &name : attributeNames)
     {
-        if (fh.readPage(0, pageData))
-            return RBFM_READ_FAILED;
+        auto pred = [&](const Attribute &a) {return a.name == name;};
+        auto iterPos = find_if(recordDescriptor.begin(), recordDescriptor.end(), pred);
+        if (iterPos == recordDescriptor.end())
+            return RBFM_NO_SUCH_ATTR;
+        projection.push_back(distance(recordDescriptor.begin(), iterPos));
     }
-    else
-        return SUCCESS;
+    projectionNullIndicatorSize = rbfm->getNullIndicatorSize(projection.size());
 
-    // Get number of slots on first page
-    SlotDirectoryHeader header = rbfm->getSlotDirectoryHeader(pageData);
-    totalSlot = header.recordEntriesNumber;
-
-    // If we don't need to do any comparisons, we can ignore the condition attribute
-    if (co == NO_OP)
-        return SUCCESS;
+    // If we need to do comparisons, find the condition attribute's index in the record descriptor
+    if (co != NO_OP)
+    {
+        auto pred = [&](Attribute a) {return a.name == conditionAttribute;};
+        auto iterPos = find_if(recordDescriptor.begin(), recordDescriptor.end(), pred);
+        attrIndex = distance(recordDescriptor.begin(), iterPos);
+        if (attrIndex == recordDescriptor.size())
+            return RBFM_NO_SUCH_ATTR;
 
-    // Else, we need to find the condition attribute's index in the record descriptor
-    auto pred = [&](Attribute a) {return a.name == conditionAttribute;};
-    auto iterPos = find_if(recordDescriptor.begin(), recordDescriptor.end(), pred);
-    attrIndex = distance(recordDescriptor.begin(), iterPos);
-    if (attrIndex == recordDescriptor.size())
-        return RBFM_NO_SUCH_ATTR;
+        type = recordDescriptor[attrIndex].type;
+        predicate = Predicate(type, co);
+    }
 
-    return SUCCESS;
+    // Get total number of pages, and read in the first one if there is one
+    totalPage = fh.getNumberOfPages();
+    if (totalPage <= currPage)
+        return SUCCESS;
+    return getNextPage();
 }
 
 RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data)
@@ -544,67 +596,33 @@ RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data)
         return SUCCESS;
     }
 
-    // Prepare null indicator
-    unsigned nullIndicatorSize = rbfm->getNullIndicatorSize(attributeNames.size());
-    char nullIndicator[nullIndicatorSize];
-    memset(nullIndicator, 0, nullIndicatorSize);
-
-    SlotDirectoryRecordEntry recordEntry = rbfm->getSlotDirectoryRecordEntry(pageData, currSlot);
-
-    // Unsure how large each attribute will be, set to size of page to be safe
-    void *buffer = malloc(PAGE_SIZE);
-    if (buffer == NULL)
-        return RBFM_MALLOC_FAILED;
+    SlotDirectoryRecordEntry recordEntry = rbfm->getSlotDirectoryRecordEntry(page, currSlot);
 
-    // Keep track of offset into data
-    unsigned dataOffset = nullIndicatorSize;
+    // Copy each projected field straight from the page into data
+    char *nullIndicator = (char*)data;
+    memset(nullIndicator, 0, projectionNullIndicatorSize);
+    unsigned dataOffset = projectionNullIndicatorSize;
 
-    for (unsigned i = 0; i < attributeNames.size(); i++)
+    for (unsigned i = 0; i < projection.size(); i++)
     {
-        // Get index and type of attribute in record
-        auto pred = [&](Attribute a) {return a.name == attributeNames[i];};
-        auto iterPos = find_if(recordDescriptor.begin(), recordDescriptor.end(), pred);
-        unsigned index = distance(recordDescriptor.begin(), iterPos);
-        if (index == recordDescriptor.size())
-            return RBFM_NO_SUCH_ATTR;
-        AttrType type = recordDescriptor[index].type;
-
-        // Read attribute into buffer
-        rbfm->getAttributeFromRecord(pageData, recordEntry.offset, index, type, buffer);
-        // Determine if null
-        char null;
-        memcpy (&null, buffer, 1);
-        if (null)
-        {
-            int indicatorIndex = i / CHAR_BIT;
-            char indicatorMask  = 1 << (CHAR_BIT - 1 - (i % CHAR_BIT));
-            nullIndicator[indicatorIndex] |= indicatorMask;
-        }
-        // Read from buffer into data
-        else if (type == TypeInt)
-        {
-            memcpy ((char*)data + dataOffset, (char*)buffer + 1, INT_SIZE);
-            dataOffset += INT_SIZE;
-        }
-        else if (type == TypeReal)
+        char *field;
+        uint32_t length;
+        if (!getField(recordEntry.offset, projection[i], field, length))
         {
-            memcpy ((char*)data + dataOffset, (char*)buffer + 1, REAL_SIZE);
-            dataOffset += REAL_SIZE;
+            nullIndicator[i / CHAR_BIT] |= 1 << (CHAR_BIT - 1 - (i % CHAR_BIT));
+            continue;
         }
-        else if (type == TypeVarChar)
+
+        // VarChars are preceded by their length
+        if (recordDescriptor[projection[i]].type == TypeVarChar)
         {
-            uint32_t varcharSize;
-            memcpy(&varcharSize, (char*)buffer + 1, VARCHAR_LENGTH_SIZE);
-            memcpy((char*)data + dataOffset, &varcharSize, VARCHAR_LENGTH_SIZE);
+            memcpy((char*)data + dataOffset, &length, VARCHAR_LENGTH_SIZE);
             dataOffset += VARCHAR_LENGTH_SIZE;
-            memcpy((char*)data + dataOffset, (char*)buffer + 1 + VARCHAR_LENGTH_SIZE, varcharSize);
-            dataOffset += varcharSize;
         }
+        memcpy((char*)data + dataOffset, field, length);
+        dataOffset += length;
     }
-    // Finally set null indicator of data, clean up and return
-    memcpy((char*)data, nullIndicator, nullIndicatorSize);
 
-    free (buffer);
     rid.pageNum = currPage;
     rid.slotNum = currSlot++;
     return SUCCESS;
@@ -614,12 +632,39 @@ RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data)
 
 RC RBFM_ScanIterator::getNextSlot()
 {
-    // If we're done with the current page, or we've read the last page
-    if (currSlot >= totalSlot || currPage >= totalPage)
+    while (true)
     {
-        // Reinitialize the current slot and increment page number
+        // Find the next slot of the current page that holds a matching record
+        if (currPage < totalPage)
+        {
+            // A page in the file's mapping changes as soon as a write to it reaches the file, so once the file has
+            // changed finish the page from a copy, matched again so deleted and updated records aren't returned
+            if (page != pageData && fileHandle.getFileVersion() != pageVersion)
+            {
+                if (fileHandle.readPage(currPage, pageData))
+                    return RBFM_READ_FAILED;
+                page = pageData;
+                matchSlots();
+            }
+
+            while (currSlot < totalSlot)
+            {
+                uint64_t word = slotMatches[currSlot / 64] >> (currSlot % 64);
+                if (word)
+                {
+                    currSlot += __builtin_ctzll(word);
+                    return SUCCESS;
+                }
+                // Nothing else matches in this word, so skip to the start of the next one
+                currSlot = (currSlot / 64 + 1) * 64;
+            }
+        }
+
+        // Reinitialize the current slot and increment page number, skipping free space map pages
         currSlot = 0;
         currPage++;
+        if (rbfm->isFreeSpaceMapPage(currPage))
+            currPage++;
         // If we're done with last page, return EOF
         if (currPage >= totalPage)
             return RBFM_EOF;
@@ -628,141 +673,155 @@ RC RBFM_ScanIterator::getNextSlot()
         if (rc)
             return rc;
     }
+}
 
-    // Get slot header, check to see if valid and meets scan condition
-    SlotDirectoryRecordEntry recordEntry = rbfm->getSlotDirectoryRecordEntry(pageData, currSlot);
-
-    if (rbfm->getSlotStatus(recordEntry) != VALID || !checkScanCondition())
+RC RBFM_ScanIterator::getNextPage()
+{
+    // Bring the next pages into the buffer pool with all of their reads in flight at once
+    if (currPage >= prefetchEnd)
     {
-        // If not, try next slot
-        currSlot++;
-        return getNextSlot();
+        fileHandle.prefetchPages(currPage, RBFM_SCAN_PREFETCH);
+        prefetchEnd = currPage + RBFM_SCAN_PREFETCH;
     }
+
+    // Read in page, or use it in place if the file is mapped
+    pageVersion = fileHandle.getFileVersion();
+    if (fileHandle.viewPage(currPage, pageData, page))
+        return RBFM_READ_FAILED;
+
+    matchSlots();
     return SUCCESS;
 }
 
-RC RBFM_ScanIterator::getNextPage()
+void RBFM_ScanIterator::matchSlots()
 {
-    // Read in page
-    if (fileHandle.readPage(currPage, pageData))
-        return RBFM_READ_FAILED;
-
     // Update slot total
-    SlotDirectoryHeader header = rbfm->getSlotDirectoryHeader(pageData);
+    SlotDirectoryHeader header = rbfm->getSlotDirectoryHeader(page);
     totalSlot = header.recordEntriesNumber;
-    return SUCCESS;
+
+    // Check every slot of the page in one pass, setting a bit for each one that holds a matching record
+    slotMatches.assign((totalSlot + 63) / 64, 0);
+    for (unsigned slot = 0; slot < totalSlot; slot++)
+    {
+        SlotDirectoryRecordEntry recordEntry = rbfm->getSlotDirectoryRecordEntry(page, slot);
+        if (rbfm->getSlotStatus(recordEntry) == VALID && checkScanCondition(recordEntry))
+            slotMatches[slot / 64] |= (uint64_t) 1 << (slot % 64);
+    }
 }
 
-bool RBFM_ScanIterator::checkScanCondition()
+bool RBFM_ScanIterator::checkScanCondition(const SlotDirectoryRecordEntry &recordEntry)
 {
     if (compOp == NO_OP) return true;
     if (value == NULL) return false;
-    Attribute attr = recordDescriptor[attrIndex];
-    // Allocate enough memory to hold attribute and 1 byte null indicator
-    void *data = malloc(1 + attr.length);
-    // Get record entry to get offset
-    SlotDirectoryRecordEntry recordEntry = rbfm->getSlotDirectoryRecordEntry(pageData, currSlot);
-    // Grab the given attribute and store it in data
-    rbfm->getAttributeFromRecord(pageData, recordEntry.offset, attrIndex, attr.type, data);
-
-    char null;
-    memcpy(&null, data, 1);
-
-    bool result = false;
-    if (null)
-    {
-        result = false;
-    }
-    // Checkscan condition on record data and scan value
-    else if (attr.type == TypeInt)
-    {
-        int32_t recordInt;
-        memcpy(&recordInt, (char*)data + 1, INT_SIZE);
-        result = checkScanCondition(recordInt, compOp, value);
-    }
-    else if (attr.type == TypeReal)
-    {
-        float recordReal;
-        memcpy(&recordReal, (char*)data + 1, REAL_SIZE);
-        result = checkScanCondition(recordReal, compOp, value);
-    }
-    else if (attr.type == TypeVarChar)
-    {
-        uint32_t varcharSize;
-        memcpy(&varcharSize, (char*)data + 1, VARCHAR_LENGTH_SIZE);
-        char recordString[varcharSize + 1];
-        memcpy(recordString, (char*)data + 1 + VARCHAR_LENGTH_SIZE, varcharSize);
-        recordString[varcharSize] = '\0';
 
-        result = checkScanCondition(recordString, compOp, value);
-    }
-    free (data);
-    return result;
+    // Null never satisfies the condition
+    char *field;
+    uint32_t length;
+    if (!getField(recordEntry.offset, attrIndex, field, length))
+        return false;
+
+    // Ints and reals can be compared in the page, varchars need their length in front
+    if (type != TypeVarChar)
+        return predicate(field, value);
+    memcpy(conditionData, &length, VARCHAR_LENGTH_SIZE);
+    memcpy((char*)conditionData + VARCHAR_LENGTH_SIZE, field, length);
+    return predicate(conditionData, value);
 }
 
-bool RBFM_ScanIterator::checkScanCondition(int recordInt, CompOp compOp, const void *value)
+// Find field i of the record at recordOffset in the current page, pointing field at it. Returns false if the field is null
+bool RBFM_ScanIterator::getField(unsigned recordOffset, unsigned i, char *&field, uint32_t &length)
 {
-    int32_t intValue;
-    memcpy (&intValue, value, INT_SIZE);
+    char *record = (char*)page + recordOffset;
+    RecordLength n;
+    memcpy(&n, record, sizeof(RecordLength));
 
-    switch (compOp)
-    {
-        case EQ_OP: return recordInt == intValue;
-        case LT_OP: return recordInt < intValue;
-        case GT_OP: return recordInt > intValue;
-        case LE_OP: return recordInt <= intValue;
-        case GE_OP: return recordInt >= intValue;
-        case NE_OP: return recordInt != intValue;
-        case NO_OP: return true;
-        // Should never happen
-        default: return false;
-    }
+    if (rbfm->fieldIsNull(record + sizeof(RecordLength), i))
+        return false;
+
+    // The record's directory holds the offset where each field ends, and the first field starts right after it
+    unsigned headerOffset = sizeof(RecordLength) + rbfm->getNullIndicatorSize(n);
+    ColumnOffset start, end;
+    memcpy(&end, record + headerOffset + i * sizeof(ColumnOffset), sizeof(ColumnOffset));
+    if (i > 0)
+        memcpy(&start, record + headerOffset + (i - 1) * sizeof(ColumnOffset), sizeof(ColumnOffset));
+    else
+        start = headerOffset + n * sizeof(ColumnOffset);
+
+    field = record + start;
+    length = end - start;
+    return true;
 }
 
-bool RBFM_ScanIterator::checkScanCondition(float recordReal, CompOp compOp, const void *value)
-{
-    float realValue;
-    memcpy (&realValue, value, REAL_SIZE);
+// Predicate ////////////////////////////////////////////////////////////////////////////////
 
-    switch (compOp)
+// O is a template argument, so the switch is resolved when each evaluator is compiled
+template <CompOp O, typename T>
+static inline bool applyCompOp(T lhs, T rhs)
+{
+    switch (O)
     {
-        case EQ_OP: return recordReal == realValue;
-        case LT_OP: return recordReal < realValue;
-        case GT_OP: return recordReal > realValue;
-        case LE_OP: return recordReal <= realValue;
-        case GE_OP: return recordReal >= realValue;
-        case NE_OP: return recordReal != realValue;
+        case EQ_OP: return lhs == rhs;
+        case LT_OP: return lhs <  rhs;
+        case GT_OP: return lhs >  rhs;
+        case LE_OP: return lhs <= rhs;
+        case GE_OP: return lhs >= rhs;
+        case NE_OP: return lhs != rhs;
         case NO_OP: return true;
         // Should never happen
         default: return false;
     }
 }
 
-bool RBFM_ScanIterator::checkScanCondition(char *recordString, CompOp compOp, const void *value)
+template <AttrType T, CompOp O>
+bool Predicate::evaluate(const void *lhs, const void *rhs)
 {
-    if (compOp == NO_OP)
-        return true;
-
-    int32_t valueSize;
-    memcpy(&valueSize, value, VARCHAR_LENGTH_SIZE);
-    char valueStr[valueSize + 1];
-    valueStr[valueSize] = '\0';
-    memcpy(valueStr, (char*) value + VARCHAR_LENGTH_SIZE, valueSize);
-
-    int cmp = strcmp(recordString, valueStr);
-    switch (compOp)
+    switch (T)
     {
-        case EQ_OP: return cmp == 0;
-        case LT_OP: return cmp <  0;
-        case GT_OP: return cmp >  0;
-        case LE_OP: return cmp <= 0;
-        case GE_OP: return cmp >= 0;
-        case NE_OP: return cmp != 0;
+        case TypeInt:
+        {
+            int32_t lhsInt, rhsInt;
+            memcpy(&lhsInt, lhs, INT_SIZE);
+            memcpy(&rhsInt, rhs, INT_SIZE);
+            return applyCompOp<O>(lhsInt, rhsInt);
+        }
+        case TypeReal:
+        {
+            float lhsReal, rhsReal;
+            memcpy(&lhsReal, lhs, REAL_SIZE);
+            memcpy(&rhsReal, rhs, REAL_SIZE);
+            return applyCompOp<O>(lhsReal, rhsReal);
+        }
+        case TypeVarChar:
+        {
+            // Order by the common prefix, then by length
+            uint32_t lhsSize, rhsSize;
+            memcpy(&lhsSize, lhs, VARCHAR_LENGTH_SIZE);
+            memcpy(&rhsSize, rhs, VARCHAR_LENGTH_SIZE);
+            int cmp = memcmp((const char*)lhs + VARCHAR_LENGTH_SIZE, (const char*)rhs + VARCHAR_LENGTH_SIZE, min(lhsSize, rhsSize));
+            if (cmp == 0)
+                cmp = (lhsSize > rhsSize) - (lhsSize < rhsSize);
+            return applyCompOp<O>(cmp, 0);
+        }
         // Should never happen
         default: return false;
     }
 }
 
+Predicate::Predicate(AttrType type, CompOp op)
+: type(type), op(op)
+{
+    // One evaluator for every type and operator, in the order they are declared
+    static const Evaluator evaluators[3][7] = {
+        {evaluate<TypeInt, EQ_OP>, evaluate<TypeInt, LT_OP>, evaluate<TypeInt, LE_OP>, evaluate<TypeInt, GT_OP>,
+         evaluate<TypeInt, GE_OP>, evaluate<TypeInt, NE_OP>, evaluate<TypeInt, NO_OP>},
+        {evaluate<TypeReal, EQ_OP>, evaluate<TypeReal, LT_OP>, evaluate<TypeReal, LE_OP>, evaluate<TypeReal, GT_OP>,
+         evaluate<TypeReal, GE_OP>, evaluate<TypeReal, NE_OP>, evaluate<TypeReal, NO_OP>},
+        {evaluate<TypeVarChar, EQ_OP>, evaluate<TypeVarChar, LT_OP>, evaluate<TypeVarChar, LE_OP>, evaluate<TypeVarChar, GT_OP>,
+         evaluate<TypeVarChar, GE_OP>, evaluate<TypeVarChar, NE_OP>, evaluate<TypeVarChar, NO_OP>},
+    };
+    evaluator = evaluators[type][op];
+}
+
 // Configures a new record based page, and puts it in "page".
 void RecordBasedFileManager::newRecordBasedPage(void * page)
 {
@@ -774,6 +833,174 @@ void RecordBasedFileManager::newRecordBasedPage(void * page)
     setSlotDirectoryHeader(page, slotHeader);
 }
 
+bool RecordBasedFileManager::isFreeSpaceMapPage(PageNum pageNum)
+{
+    return pageNum % FSM_PAGE_INTERVAL == 0;
+}
+
+// Finds a record based page with at least size bytes free using the free space map.
+// Map pages whose summary shows no entry is large enough are skipped, so usually only the map page holding
+// the entry found is read.
+RC RecordBasedFileManager::findFreePage(FileHandle &fileHandle, unsigned size, PageNum &pageNum, bool &found)
+{
+    found = false;
+
+    // Smallest bucket guaranteed to hold size bytes
+    unsigned bucket = (size + FSM_BUCKET_SIZE - 1) / FSM_BUCKET_SIZE;
+    if (bucket > UCHAR_MAX)
+        return SUCCESS;
+
+    vector<unsigned char> *summary = fileHandle.getFreeSpaceSummary();
+    unsigned char fsm[PAGE_SIZE];
+    unsigned numPages = fileHandle.getNumberOfPages();
+    for (PageNum fsmPage = 0; fsmPage < numPages; fsmPage += FSM_PAGE_INTERVAL)
+    {
+        unsigned n = fsmPage / FSM_PAGE_INTERVAL;
+        if (summary != NULL && n < summary->size() && (*summary)[n] < bucket)
+            continue;
+
+        if (fileHandle.readPage(fsmPage, fsm))
+            return RBFM_READ_FAILED;
+
+        unsigned char largest = 0;
+        for (unsigned i = 0; i < FSM_ENTRIES_PER_PAGE && fsmPage + 1 + i < numPages; i++)
+        {
+            if (fsm[i] >= bucket)
+            {
+                pageNum = fsmPage + 1 + i;
+                found = true;
+                return SUCCESS;
+            }
+            largest = max(largest, fsm[i]);
+        }
+
+        // Remember how much room the page has at most, so it isn't read again until some entry grows past that.
+        // Map pages not summarized yet have to be read
+        if (summary != NULL)
+        {
+            if (n >= summary->size())
+                summary->resize(n + 1, UCHAR_MAX);
+            (*summary)[n] = largest;
+        }
+    }
+    return SUCCESS;
+}
+
+// Records the free space of a record based page in its free space map entry
+RC RecordBasedFileManager::updateFreeSpaceMap(FileHandle &fileHandle, PageNum pageNum, void *page)
+{
+    PageNum fsmPage = pageNum - pageNum % FSM_PAGE_INTERVAL;
+    unsigned entry = pageNum - fsmPage - 1;
+
+    // Round down so the map never promises more space than there is
+    unsigned bucket = getPageFreeSpaceSize(page) / FSM_BUCKET_SIZE;
+    if (bucket > UCHAR_MAX)
+        bucket = UCHAR_MAX;
+
+    unsigned char fsm[PAGE_SIZE];
+    if (fileHandle.readPage(fsmPage, fsm))
+        return RBFM_READ_FAILED;
+
+    // Only write the map back if the entry changed
+    if (fsm[entry] == bucket)
+        return SUCCESS;
+    fsm[entry] = bucket;
+    if (fileHandle.writePage(fsmPage, fsm))
+        return RBFM_WRITE_FAILED;
+
+    // The summary only has to bound the entries, so it is raised when one grows past it but left alone when one shrinks
+    vector<unsigned char> *summary = fileHandle.getFreeSpaceSummary();
+    unsigned n = fsmPage / FSM_PAGE_INTERVAL;
+    if (summary != NULL && n < summary->size() && (*summary)[n] < bucket)
+        (*summary)[n] = bucket;
+    return SUCCESS;
+}
+
+// Reads in a page with at least recordSize bytes free for a new record and its slot, or sets up a new one
+// if there is none. pageFound tells whether the page already exists in the file.
+RC RecordBasedFileManager::getPageForRecord(FileHandle &fileHandle, unsigned recordSize, void *pageData, PageNum &pageNum, bool &pageFound, bool append)
+{
+    if (append)
+    {
+        // Only the last page can be used, so records stay in order
+        pageNum = fileHandle.getNumberOfPages() - 1;
+        pageFound = false;
+        if (!isFreeSpaceMapPage(pageNum))
+        {
+            if (fileHandle.readPage(pageNum, pageData))
+                return RBFM_READ_FAILED;
+            pageFound = getPageFreeSpaceSize(pageData) >= sizeof(SlotDirectoryRecordEntry) + recordSize;
+        }
+    }
+    // Looks up a page with enough free space in the free space map.
+    else if (findFreePage(fileHandle, sizeof(SlotDirectoryRecordEntry) + recordSize, pageNum, pageFound))
+        return RBFM_READ_FAILED;
+
+    if (pageFound)
+    {
+        if (!append && fileHandle.readPage(pageNum, pageData))
+            return RBFM_READ_FAILED;
+        return SUCCESS;
+    }
+
+    // If we can't find a page with enough space, we create a new one
+    pageNum = fileHandle.getNumberOfPages();
+    // The new page may land where the next free space map page belongs, in which case that goes first
+    if (isFreeSpaceMapPage(pageNum))
+    {
+        memset(pageData, 0, PAGE_SIZE);
+        if (fileHandle.appendPage(pageData))
+            return RBFM_APPEND_FAILED;
+        pageNum++;
+    }
+    newRecordBasedPage(pageData);
+    return SUCCESS;
+}
+
+// Adds a record to a page in memory that is known to have room for it
+void RecordBasedFileManager::setRecordOnPage(void *pageData, PageNum pageNum, const vector<Attribute> &recordDescriptor, const void *data, unsigned recordSize, RID &rid)
+{
+    SlotDirectoryHeader slotHeader = getSlotDirectoryHeader(pageData);
+
+    // Setting the return RID.
+    rid.pageNum = pageNum;
+    rid.slotNum = getOpenSlot(pageData);
+
+    // Adding the new record reference in the slot directory.
+    SlotDirectoryRecordEntry newRecordEntry;
+    newRecordEntry.length = recordSize;
+    newRecordEntry.offset = slotHeader.freeSpaceOffset - recordSize;
+    setSlotDirectoryRecordEntry(pageData, rid.slotNum, newRecordEntry);
+
+    // Updating the slot directory header.
+    slotHeader.freeSpaceOffset = newRecordEntry.offset;
+    if (rid.slotNum == slotHeader.recordEntriesNumber)
+        slotHeader.recordEntriesNumber += 1;
+    setSlotDirectoryHeader(pageData, slotHeader);
+
+    // Adding the record data.
+    setRecordAtOffset (pageData, newRecordEntry.offset, recordDescriptor, data);
+}
+
+// Writes a page returned by getPageForRecord to disk and keeps the free space map up to date
+RC RecordBasedFileManager::writeRecordPage(FileHandle &fileHandle, PageNum pageNum, void *pageData, bool pageFound)
+{
+    if (pageFound)
+    {
+        if (fileHandle.writePage(pageNum, pageData))
+            return RBFM_WRITE_FAILED;
+    }
+    else
+    {
+        if (fileHandle.appendPage(pageData))
+            return RBFM_APPEND_FAILED;
+    }
+
+    if (updateFreeSpaceMap(fileHandle, pageNum, pageData))
+        return RBFM_WRITE_FAILED;
+    return SUCCESS;
+}
+
 SlotDirectoryHeader RecordBasedFileManager::getSlotDirectoryHeader(void * page)
 {
     // Getting the slot directory header.
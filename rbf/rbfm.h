@@ -23,6 +23,12 @@
 #define RBFM_READ_AFTER_DEL 8
 #define RBFM_NO_SUCH_ATTR   9
 
+// Free space map. Page 0 of every record based file and every FSM_PAGE_INTERVAL-th page after it
+// hold one byte for each of the data pages that follow, giving the page's free space in units of FSM_BUCKET_SIZE bytes.
+#define FSM_ENTRIES_PER_PAGE    PAGE_SIZE
+#define FSM_PAGE_INTERVAL       (FSM_ENTRIES_PER_PAGE + 1)
+#define FSM_BUCKET_SIZE         (PAGE_SIZE / 256)
+
 using namespace std;
 
 // Record ID
@@ -58,6 +64,30 @@ typedef enum
     NO_OP       // no condition
 } CompOp;
 
+// A comparison "lhs op rhs" of two values of one type, in the format used by insertRecord()
+// (4 bytes for Int and Real, a 4 byte length then the characters for VarChar).
+// The type and operator are fixed when the predicate is made, so evaluating it for each record
+// is a single call to code specialized for them. VarChars compare their bytes with memcmp.
+class Predicate
+{
+public:
+  Predicate(AttrType type = TypeInt, CompOp op = NO_OP);
+
+  bool operator()(const void *lhs, const void *rhs) const { return evaluator(lhs, rhs); }
+
+  AttrType getType() const { return type; }
+  CompOp getOp() const { return op; }
+
+private:
+  typedef bool (*Evaluator)(const void *lhs, const void *rhs);
+
+  AttrType type;
+  CompOp op;
+  Evaluator evaluator;
+
+  template <AttrType T, CompOp O> static bool evaluate(const void *lhs, const void *rhs);
+};
+
 // Slot directory headers for page organization
 // See chapter 9.6.2 of the cow book or lecture 3 slide 16 for more information
 typedef struct SlotDirectoryHeader
@@ -93,6 +123,9 @@ The scan iterator is NOT required to be implemented for the part 1 of the projec
 
 # define RBFM_EOF (-1)  // end of a scan operator
 
+// Pages a scan reads into the buffer pool together, ahead of the page it is on
+#define RBFM_SCAN_PREFETCH 32
+
 // RBFM_ScanIterator is an iterator to go through records
 // The way to use it is like the following:
 //  RBFM_ScanIterator rbfmScanIterator;
@@ -124,11 +157,20 @@ private:
 
   uint32_t totalPage;
   uint16_t totalSlot;
+  uint32_t prefetchEnd;  // first page past the ones already read into the buffer pool
 
   void *pageData;
+  void *page;           // current page, either pageData or the page in the file's mapping
+  unsigned pageVersion; // version of the file when page was read
+  void *conditionData;  // condition attribute of the current record in insertRecord() format
 
   AttrType type;
   unsigned attrIndex;
+  Predicate predicate;  // compOp on the condition attribute's type
+
+  vector<uint64_t> slotMatches;  // bit for each slot of the current page holding a record that satisfies the condition
+  vector<unsigned> projection;   // index in recordDescriptor of each of attributeNames
+  unsigned projectionNullIndicatorSize;
 
   FileHandle fileHandle;
   vector<Attribute> recordDescriptor;
@@ -148,12 +190,10 @@ private:
 
   RC getNextSlot();
   RC getNextPage();
+  void matchSlots();
   RC handleMovedRecord(bool &status, const RID rid, void *data);
-  bool checkScanCondition();
-  RC checkScanCondition(bool &result, const RID rid);
-  bool checkScanCondition(int, CompOp, const void*);
-  bool checkScanCondition(float, CompOp, const void*);
-  bool checkScanCondition(char*, CompOp, const void*);
+  bool checkScanCondition(const SlotDirectoryRecordEntry &recordEntry);
+  bool getField(unsigned recordOffset, unsigned i, char *&field, uint32_t &length);
 };
 
 
@@ -166,7 +206,8 @@ public:
   
   RC destroyFile(const string &fileName);
   
-  RC openFile(const string &fileName, FileHandle &fileHandle);
+  // A file opened with FH_MAPPED is read only. Reads and scans use its pages in place instead of copying them.
+  RC openFile(const string &fileName, FileHandle &fileHandle, FileMode mode = FH_READ_WRITE);
   
   RC closeFile(FileHandle &fileHandle);
 
@@ -186,6 +227,14 @@ public:
   // For example, refer to the Q6 of Project 1 Environment document.
   RC insertRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const void *data, RID &rid);
 
+  // Inserts every record of data, in the same format as insertRecord(), and returns their RIDs in order.
+  // Each page is filled with as many records as fit before it is written.
+  RC insertRecords(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const vector<const void *> &data, vector<RID> &rids);
+
+  // Same as insertRecords(), but records are only ever added at the end of the file, so a scan returns them in the
+  // order they were given. Meant for temporary files such as sorted runs.
+  RC appendRecords(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const vector<const void *> &data, vector<RID> &rids);
+
   RC readRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid, void *data);
   
   // This method will be mainly used for debugging/testing. 
@@ -231,6 +280,15 @@ private:
 
   void newRecordBasedPage(void * page);
 
+  bool isFreeSpaceMapPage(PageNum pageNum);
+  RC findFreePage(FileHandle &fileHandle, unsigned size, PageNum &pageNum, bool &found);
+  RC updateFreeSpaceMap(FileHandle &fileHandle, PageNum pageNum, void *page);
+
+  RC insertRecordBatch(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const vector<const void *> &data, vector<RID> &rids, bool append);
+  RC getPageForRecord(FileHandle &fileHandle, unsigned recordSize, void *pageData, PageNum &pageNum, bool &pageFound, bool append = false);
+  void setRecordOnPage(void *pageData, PageNum pageNum, const vector<Attribute> &recordDescriptor, const void *data, unsigned recordSize, RID &rid);
+  RC writeRecordPage(FileHandle &fileHandle, PageNum pageNum, void *pageData, bool pageFound);
+
   SlotDirectoryHeader getSlotDirectoryHeader(void * page);
   void setSlotDirectoryHeader(void * page, SlotDirectoryHeader slotHeader);
 
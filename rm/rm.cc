@@ -18,10 +18,13 @@ RelationManager::RelationManager()
 }
 
 RelationManager::~RelationManager() {
+    closeOpenFiles();
 }
 
 RC RelationManager::createCatalog() {
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    catalogCache.clear();
+    closeOpenFiles();
     // Create both tables and columns tables, return error if either fails
     RC rc;
     rc = rbfm->createFile(getFileName(TABLES_TABLE_NAME));
@@ -62,6 +65,8 @@ RC RelationManager::createCatalog() {
 // Just delete the the two catalog files
 RC RelationManager::deleteCatalog() {
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    catalogCache.clear();
+    closeOpenFiles();
 
     RC rc;
 
@@ -83,6 +88,8 @@ RC RelationManager::deleteCatalog() {
 RC RelationManager::createTable(const string &tableName, const vector<Attribute> &attrs) {
     RC rc;
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    catalogCache.erase(tableName);
+    closeOpenFile(getFileName(tableName));
 
     // Create the rbfm file to store the table
     if ((rc = rbfm->createFile(getFileName(tableName))))
@@ -120,15 +127,17 @@ RC RelationManager::deleteTable(const string &tableName) {
         return RM_CANNOT_MOD_SYS_TBL;
 
     // Delete the rbfm file holding this table's entries
+    closeOpenFile(getFileName(tableName));
     rc = rbfm->destroyFile(getFileName(tableName));
     if (rc)
         return rc;
 
-    // Grab the table ID
+    // Grab the table ID, then forget the cached entry
     int32_t id;
     rc = getTableID(tableName, id);
     if (rc)
         return rc;
+    catalogCache.erase(tableName);
 
     // Open tables file
     FileHandle fileHandle;
@@ -179,16 +188,22 @@ RC RelationManager::deleteTable(const string &tableName) {
 
 // Fills the given attribute vector with the recordDescriptor of tableName
 RC RelationManager::getAttributes(const string &tableName, vector<Attribute> &attrs) {
+    CatalogEntry *entry;
+    RC rc = getCatalogEntry(tableName, entry);
+    if (rc)
+        return rc;
+
+    attrs = entry->recordDescriptor;
+    return SUCCESS;
+}
+
+// Reads the recordDescriptor of the table with the given id from the Columns table
+RC RelationManager::loadAttributes(int32_t id, vector<Attribute> &attrs) {
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     // Clear out any old values
     attrs.clear();
     RC rc;
 
-    int32_t id;
-    rc = getTableID(tableName, id);
-    if (rc)
-        return rc;
-
     void *value = &id;
 
     // We need to get the three values that make up an Attribute: name, type, length
@@ -281,66 +296,108 @@ RC RelationManager::insertTuple(const string &tableName, const void *data, RID &
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     RC rc;
 
-    // If this is a system table, we cannot modify it
-    bool isSystem;
-    rc = isSystemTable(isSystem, tableName);
+    // Look up the table in the catalog
+    CatalogEntry *entry;
+    rc = getCatalogEntry(tableName, entry);
     if (rc)
         return rc;
-    if (isSystem)
-        return RM_CANNOT_MOD_SYS_TBL;
 
-    // Get recordDescriptor
-    vector<Attribute> recordDescriptor;
-    rc = getAttributes(tableName, recordDescriptor);
-    if (rc)
-        return rc;
+    // If this is a system table, we cannot modify it
+    if (entry->system)
+        return RM_CANNOT_MOD_SYS_TBL;
+    vector<Attribute> &recordDescriptor = entry->recordDescriptor;
 
     // And get fileHandle
-    FileHandle fileHandle;
-    rc = rbfm->openFile(getFileName(tableName), fileHandle);
+    FileHandle *fileHandle;
+    rc = getFileHandle(entry->fileName, fileHandle);
     if (rc)
         return rc;
 
     // Let rbfm do all the work
-    rc = rbfm->insertRecord(fileHandle, recordDescriptor, data, rid);
-    rbfm->closeFile(fileHandle);
+    rc = rbfm->insertRecord(*fileHandle, recordDescriptor, data, rid);
 
     //extension
     return insertExtension(const_cast<void*>(data), recordDescriptor, tableName, rid);
 }
 
-RC RelationManager::deleteTuple(const string &tableName, const RID &rid) {
+RC RelationManager::insertTuples(const string &tableName, const vector<const void *> &tuples, vector<RID> &rids) {
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     RC rc;
 
-    // If this is a system table, we cannot modify it
-    bool isSystem;
-    rc = isSystemTable(isSystem, tableName);
+    // Look up the table in the catalog
+    CatalogEntry *entry;
+    rc = getCatalogEntry(tableName, entry);
     if (rc)
         return rc;
-    if (isSystem)
+
+    // If this is a system table, we cannot modify it
+    if (entry->system)
         return RM_CANNOT_MOD_SYS_TBL;
+    vector<Attribute> &recordDescriptor = entry->recordDescriptor;
 
-    // Get recordDescriptor
-    vector<Attribute> recordDescriptor;
-    rc = getAttributes(tableName, recordDescriptor);
+    // And get fileHandle
+    FileHandle *fileHandle;
+    rc = getFileHandle(entry->fileName, fileHandle);
     if (rc)
         return rc;
 
+    // Let rbfm pack the records into pages
+    rc = rbfm->insertRecords(*fileHandle, recordDescriptor, tuples, rids);
+    if (rc)
+        return rc;
+
+    // Then add the whole batch to each index in turn
+    vector<IndexedAttr> &indexedAttrs = entry->indexedAttrs;
+    IndexManager *im = IndexManager::instance();
+    for (unsigned i = 0; i < indexedAttrs.size(); i++) {
+        IXFileHandle *ix;
+        rc = getIXFileHandle(getIndexName(tableName, indexedAttrs[i].attr.name), ix);
+        if (rc)
+            return rc;
+
+        void *key = malloc(indexedAttrs[i].attr.length + VARCHAR_LENGTH_SIZE);
+        for (unsigned j = 0; j < tuples.size(); j++) {
+            // Nulls are not indexed
+            if (!getKeyFromTuple(tuples[j], recordDescriptor, indexedAttrs[i].pos, key))
+                continue;
+            if ((rc = im->insertEntry(*ix, indexedAttrs[i].attr, key, rids[j])))
+                break;
+        }
+        free(key);
+        if (rc)
+            return rc;
+    }
+
+    return SUCCESS;
+}
+
+RC RelationManager::deleteTuple(const string &tableName, const RID &rid) {
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    RC rc;
+
+    // Look up the table in the catalog
+    CatalogEntry *entry;
+    rc = getCatalogEntry(tableName, entry);
+    if (rc)
+        return rc;
+
+    // If this is a system table, we cannot modify it
+    if (entry->system)
+        return RM_CANNOT_MOD_SYS_TBL;
+    vector<Attribute> &recordDescriptor = entry->recordDescriptor;
 
     // And get fileHandle
-    FileHandle fileHandle;
-    rc = rbfm->openFile(getFileName(tableName), fileHandle);
+    FileHandle *fileHandle;
+    rc = getFileHandle(entry->fileName, fileHandle);
     if (rc)
         return rc;
 
     //read record in order to delete search keys in the index
     char record[PAGE_SIZE];
-    rbfm->readRecord(fileHandle, recordDescriptor, rid, record);
+    rbfm->readRecord(*fileHandle, recordDescriptor, rid, record);
 
     // Let rbfm do all the work
-    rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rid);
-    rbfm->closeFile(fileHandle);
+    rc = rbfm->deleteRecord(*fileHandle, recordDescriptor, rid);
 
     //extension
     return deleteExtension(record, recordDescriptor, tableName, rid);
@@ -350,33 +407,29 @@ RC RelationManager::updateTuple(const string &tableName, const void *data, const
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     RC rc;
 
-    // If this is a system table, we cannot modify it
-    bool isSystem;
-    rc = isSystemTable(isSystem, tableName);
+    // Look up the table in the catalog
+    CatalogEntry *entry;
+    rc = getCatalogEntry(tableName, entry);
     if (rc)
         return rc;
-    if (isSystem)
-        return RM_CANNOT_MOD_SYS_TBL;
 
-    // Get recordDescriptor
-    vector<Attribute> recordDescriptor;
-    rc = getAttributes(tableName, recordDescriptor);
-    if (rc)
-        return rc;
+    // If this is a system table, we cannot modify it
+    if (entry->system)
+        return RM_CANNOT_MOD_SYS_TBL;
+    vector<Attribute> &recordDescriptor = entry->recordDescriptor;
 
     // And get fileHandle
-    FileHandle fileHandle;
-    rc = rbfm->openFile(getFileName(tableName), fileHandle);
+    FileHandle *fileHandle;
+    rc = getFileHandle(entry->fileName, fileHandle);
     if (rc)
         return rc;
 
     //read record in order to delete search keys in the index
     char record[PAGE_SIZE];
-    rbfm->readRecord(fileHandle, recordDescriptor, rid, record);
+    rbfm->readRecord(*fileHandle, recordDescriptor, rid, record);
 
     // Let rbfm do all the work
-    rc = rbfm->updateRecord(fileHandle, recordDescriptor, data, rid);
-    rbfm->closeFile(fileHandle);
+    rc = rbfm->updateRecord(*fileHandle, recordDescriptor, data, rid);
 
     //extension
     rc = deleteExtension(record, recordDescriptor, tableName, rid);
@@ -389,21 +442,21 @@ RC RelationManager::readTuple(const string &tableName, const RID &rid, void *dat
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     RC rc;
 
-    // Get record descriptor
-    vector<Attribute> recordDescriptor;
-    rc = getAttributes(tableName, recordDescriptor);
+    // Look up the table in the catalog
+    CatalogEntry *entry;
+    rc = getCatalogEntry(tableName, entry);
     if (rc)
         return rc;
+    vector<Attribute> &recordDescriptor = entry->recordDescriptor;
 
     // And get fileHandle
-    FileHandle fileHandle;
-    rc = rbfm->openFile(getFileName(tableName), fileHandle);
+    FileHandle *fileHandle;
+    rc = getFileHandle(entry->fileName, fileHandle);
     if (rc)
         return rc;
 
     // Let rbfm do all the work
-    rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, data);
-    rbfm->closeFile(fileHandle);
+    rc = rbfm->readRecord(*fileHandle, recordDescriptor, rid, data);
     return rc;
 }
 
@@ -417,18 +470,19 @@ RC RelationManager::readAttribute(const string &tableName, const RID &rid, const
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     RC rc;
 
-    vector<Attribute> recordDescriptor;
-    rc = getAttributes(tableName, recordDescriptor);
+    // Look up the table in the catalog
+    CatalogEntry *entry;
+    rc = getCatalogEntry(tableName, entry);
     if (rc)
         return rc;
+    vector<Attribute> &recordDescriptor = entry->recordDescriptor;
 
-    FileHandle fileHandle;
-    rc = rbfm->openFile(getFileName(tableName), fileHandle);
+    FileHandle *fileHandle;
+    rc = getFileHandle(entry->fileName, fileHandle);
     if (rc)
         return rc;
 
-    rc = rbfm->readAttribute(fileHandle, recordDescriptor, rid, attributeName, data);
-    rbfm->closeFile(fileHandle);
+    rc = rbfm->readAttribute(*fileHandle, recordDescriptor, rid, attributeName, data);
     return rc;
 }
 
@@ -441,11 +495,13 @@ RC RelationManager::createIndex(const string &tableName, const string &attribute
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
 
     //create file to store index
+    closeOpenFile(getIndexName(tableName, attributeName));
     if ((rc = im->createFile(getIndexName(tableName, attributeName))))
         return rc;
 
     //insert new index into index catalog
     rc = insertIndex(tableName, attributeName);
+    catalogCache.erase(tableName);
 
     //init scan variables
     FileHandle fh;
@@ -469,9 +525,11 @@ RC RelationManager::createIndex(const string &tableName, const string &attribute
     RID rid;
     void *returnedData = malloc(attr.length + 1);
 
-    //scan rbfm to get all the entries from the tableName and insert into index
+    //scan rbfm to get all the entries from the tableName and build the index from them bottom up
     IXFileHandle ix;
     rc = im->openFile(getIndexName(tableName, attributeName), ix);
+    if (rc) return rc;
+    IX_BulkLoader loader(ix, attr);
     while ((rc = rbfm_si.getNextRecord(rid, returnedData)) == SUCCESS) {
         //skip if the attribute is null
         char null = 0;
@@ -479,10 +537,12 @@ RC RelationManager::createIndex(const string &tableName, const string &attribute
         if (null) continue;
 
         char *key = static_cast<char *>(returnedData) + 1;
-        rc = im->insertEntry(ix, attr, key, rid);
+        rc = loader.addEntry(key, rid);
         if (rc) return rc;
     }
     if (rc != RBFM_EOF) return rc;
+    rc = loader.finish();
+    if (rc) return rc;
 
     im->closeFile(ix);
     rbfm->closeFile(fh);
@@ -498,8 +558,10 @@ RC RelationManager::destroyIndex(const string &tableName, const string &attribut
     RC rc;
     string indexFileName = getIndexName(tableName, attributeName);
 
+    closeOpenFile(indexFileName);
     rc = im->destroyFile(indexFileName);
     if (rc) return rc;
+    catalogCache.erase(tableName);
 
     //delete entry in the catalog
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
@@ -784,168 +846,152 @@ RC RelationManager::insertIndex(const string &tableName, const string &attribute
 //insertTuple extension
 RC RelationManager::insertExtension(void *data, vector<Attribute> &recordDescriptor, const string &tableName, RID &rid) {
     IndexManager *im = IndexManager::instance();
-    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
-    FileHandle fh;
     RC rc;
 
-    rc = rbfm->openFile(getFileName(INDEXES_TABLE_NAME), fh);
+    vector<IndexedAttr> indexedAttrs;
+    rc = getIndexedAttributes(tableName, indexedAttrs);
     if (rc) return rc;
-    int numAttributes = recordDescriptor.size();
-    ssize_t nullByteSize = rbfm->getNullIndicatorSize(numAttributes);
-    char nullBits[nullByteSize];
-    memset(nullBits, 0, nullByteSize);
-    memcpy(nullBits, data, nullByteSize);
-    unsigned offset = nullByteSize;
-
-    for (int i = 0; i < numAttributes; i++) {
+
+    for (unsigned i = 0; i < indexedAttrs.size(); i++) {
         //skip if attribute is null
-        int indicatorIndex = i / CHAR_BIT;
-        int indicatorMask = 1 << (CHAR_BIT - 1 - (i % CHAR_BIT));
-        if ((nullBits[indicatorIndex] & indicatorMask) != 0) continue;
-
-        //if an index pertaining to the attribute exists, then insertEntry
-        RBFM_ScanIterator rbfm_si;
-        vector<string> projection;
-
-        //format the value properly
-        string indexFileName = getIndexName(tableName, recordDescriptor[i].name);
-        int indexFileLength = indexFileName.length();
-        void *value = malloc(VARCHAR_LENGTH_SIZE + indexFileLength);
-        memcpy(value, &indexFileLength, VARCHAR_LENGTH_SIZE);
-        memcpy((char*)value + VARCHAR_LENGTH_SIZE, indexFileName.c_str(), indexFileLength);
-
-        rc = rbfm->scan(fh, indexDescriptor, INDEXES_COL_FILE_NAME, EQ_OP, value, projection, rbfm_si);
-
-        RID scanRID;
-        rc = rbfm_si.getNextRecord(scanRID, NULL);
-        free(value);
-
-        if (rc == SUCCESS) {
-            IXFileHandle ix;
-            rc = im->openFile(getIndexName(tableName, recordDescriptor[i].name), ix);
-
-            //use a switch statment to figure out the type of key to insert and adjust offset
-            switch (recordDescriptor[i].type) {
-                case TypeInt: {
-                    void *key = malloc(INT_SIZE);
-                    memcpy(key, static_cast<const char *>(data) + offset, INT_SIZE);
-                    rc = im->insertEntry(ix, recordDescriptor[i], key, rid);
-                    free(key);
-                    offset += INT_SIZE;
-                    break;
-                }
-
-                case TypeReal: {
-                    void *key = malloc(REAL_SIZE);
-                    memcpy(key, static_cast<const char *>(data) + offset, REAL_SIZE);
-                    rc = im->insertEntry(ix, recordDescriptor[i], key, rid);
-                    free(key);
-                    offset += REAL_SIZE;
-                    break;
-                }
-
-                case TypeVarChar: {
-                    int varcharSize;
-                    memcpy(&varcharSize, static_cast<const char *>(data) + offset, VARCHAR_LENGTH_SIZE);
-                    void *key = malloc(VARCHAR_LENGTH_SIZE + varcharSize);
-                    memcpy(key, static_cast<const char *>(data) + offset, VARCHAR_LENGTH_SIZE + varcharSize);
-                    rc = im->insertEntry(ix, recordDescriptor[i], key, rid);
-                    free(key);
-                    offset += VARCHAR_LENGTH_SIZE + varcharSize;
-                    break;
-                }
-            }
-            rc = im->closeFile(ix);
-            if(rc) return rc;
+        void *key = malloc(indexedAttrs[i].attr.length + VARCHAR_LENGTH_SIZE);
+        if (!getKeyFromTuple(data, recordDescriptor, indexedAttrs[i].pos, key)) {
+            free(key);
+            continue;
         }
 
-        //close scanner
-        rbfm_si.close();
+        IXFileHandle *ix;
+        rc = getIXFileHandle(getIndexName(tableName, indexedAttrs[i].attr.name), ix);
+        if (rc == SUCCESS)
+            rc = im->insertEntry(*ix, indexedAttrs[i].attr, key, rid);
+        free(key);
+        if (rc) return rc;
     }
 
-    //close index catalog
-    return rbfm->closeFile(fh);
+    return SUCCESS;
 }
 
 RC RelationManager::deleteExtension(void *data, vector<Attribute> &recordDescriptor, const string &tableName, const RID &rid) {
     IndexManager *im = IndexManager::instance();
+    RC rc;
+
+    vector<IndexedAttr> indexedAttrs;
+    rc = getIndexedAttributes(tableName, indexedAttrs);
+    if (rc) return rc;
+
+    for (unsigned i = 0; i < indexedAttrs.size(); i++) {
+        //null attributes have no entry to delete
+        void *key = malloc(indexedAttrs[i].attr.length + VARCHAR_LENGTH_SIZE);
+        if (!getKeyFromTuple(data, recordDescriptor, indexedAttrs[i].pos, key)) {
+            free(key);
+            continue;
+        }
+
+        //an entry the index can't find is skipped so the other indexes still get updated
+        IXFileHandle *ix;
+        rc = getIXFileHandle(getIndexName(tableName, indexedAttrs[i].attr.name), ix);
+        if (rc == SUCCESS)
+            im->deleteEntry(*ix, indexedAttrs[i].attr, key, rid);
+        free(key);
+        if (rc) return rc;
+    }
+
+    return SUCCESS;
+}
+
+// Fills indexedAttrs with the attributes of tableName that have an index
+RC RelationManager::getIndexedAttributes(const string &tableName, vector<IndexedAttr> &indexedAttrs) {
+    CatalogEntry *entry;
+    RC rc = getCatalogEntry(tableName, entry);
+    if (rc)
+        return rc;
+
+    indexedAttrs = entry->indexedAttrs;
+    return SUCCESS;
+}
+
+// Finds the attributes of tableName that have an index in the Indexes table, with their position in recordDescriptor
+RC RelationManager::loadIndexedAttributes(const string &tableName, const vector<Attribute> &recordDescriptor, vector<IndexedAttr> &indexedAttrs) {
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     FileHandle fh;
     RC rc;
 
+    indexedAttrs.clear();
     rc = rbfm->openFile(getFileName(INDEXES_TABLE_NAME), fh);
     if (rc) return rc;
-    int numAttributes = recordDescriptor.size();
-    ssize_t nullByteSize = rbfm->getNullIndicatorSize(numAttributes);
-    char nullBits[nullByteSize];
-    memset(nullBits, 0, nullByteSize);
-    memcpy(nullBits, data, nullByteSize);
-    unsigned offset = nullByteSize;
-
-    for(int i = 0; i < numAttributes; i++) {
-        //if an index pertaining to the attribute exists then deleteEntry
-        RBFM_ScanIterator rbfm_si;
-        vector<string> projection;
-
-        //format the value properly
-        string indexFileName = getIndexName(tableName, recordDescriptor[i].name);
-        int indexFileLength = indexFileName.length();
-        void *value = malloc(VARCHAR_LENGTH_SIZE + indexFileLength);
-        memcpy(value, &indexFileLength, VARCHAR_LENGTH_SIZE);
-        memcpy((char*)value + VARCHAR_LENGTH_SIZE, indexFileName.c_str(), indexFileLength);
-
-        rc = rbfm->scan(fh, indexDescriptor, INDEXES_COL_FILE_NAME, EQ_OP, value, projection, rbfm_si);
-
-        RID scanRID;
-        rc = rbfm_si.getNextRecord(scanRID, NULL);
-        free(value);
-
-        if (rc == SUCCESS) {
-            IXFileHandle ix;
-            rc = im->openFile(getIndexName(tableName, recordDescriptor[i].name), ix);
-
-            //use a switch statment to figure out the type of key to delete and adjust offset
-            switch (recordDescriptor[i].type) {
-                case TypeInt: {
-                    void *key = malloc(INT_SIZE);
-                    memcpy(key, static_cast<const char *>(data) + offset, INT_SIZE);
-                    rc = im->deleteEntry(ix, recordDescriptor[i], key, rid);
-                    free(key);
-                    offset += INT_SIZE;
-                    break;
-                }
-
-                case TypeReal: {
-                    void *key = malloc(REAL_SIZE);
-                    memcpy(key, static_cast<const char *>(data) + offset, REAL_SIZE);
-                    rc = im->deleteEntry(ix, recordDescriptor[i], key, rid);
-                    free(key);
-                    offset += REAL_SIZE;
-                    break;
-                }
-
-                case TypeVarChar: {
-                    int varcharSize;
-                    memcpy(&varcharSize, static_cast<const char *>(data) + offset, VARCHAR_LENGTH_SIZE);
-                    void *key = malloc(VARCHAR_LENGTH_SIZE + varcharSize);
-                    memcpy(key, static_cast<const char *>(data) + offset, VARCHAR_LENGTH_SIZE + varcharSize);
-                    rc = im->deleteEntry(ix, recordDescriptor[i], key, rid);
-                    free(key);
-                    offset += VARCHAR_LENGTH_SIZE + varcharSize;
-                    break;
-                }
+
+    //format the value properly
+    int32_t nameLength = tableName.length();
+    void *value = malloc(VARCHAR_LENGTH_SIZE + nameLength);
+    memcpy(value, &nameLength, VARCHAR_LENGTH_SIZE);
+    memcpy((char*)value + VARCHAR_LENGTH_SIZE, tableName.c_str(), nameLength);
+
+    //find every index on tableName
+    RBFM_ScanIterator rbfm_si;
+    vector<string> projection{INDEXES_COL_ATTR_NAME};
+    rc = rbfm->scan(fh, indexDescriptor, INDEXES_COL_TABLE_NAME, EQ_OP, value, projection, rbfm_si);
+
+    RID rid;
+    void *data = malloc(1 + VARCHAR_LENGTH_SIZE + INDEXES_COL_ATTR_NAME_SIZE);
+    while ((rc = rbfm_si.getNextRecord(rid, data)) == SUCCESS) {
+        string attrName;
+        fromAPI(attrName, data);
+        for (unsigned i = 0; i < recordDescriptor.size(); i++) {
+            if (recordDescriptor[i].name == attrName) {
+                IndexedAttr attr;
+                attr.pos = i;
+                attr.attr = recordDescriptor[i];
+                indexedAttrs.push_back(attr);
+                break;
             }
-            //close indesx file
-            rc = im->closeFile(ix);
-            if(rc) return rc;
         }
-
-        //close scanner
-        rbfm_si.close();
     }
+    if (rc == RBFM_EOF)
+        rc = SUCCESS;
 
-    //close index catalog
-    return rbfm->closeFile(fh);
+    free(data);
+    free(value);
+    rbfm_si.close();
+    rbfm->closeFile(fh);
+    return rc;
+}
+
+// Copies the value of the attribute at position pos in an API format tuple into key.
+// Returns false if the value is null
+bool RelationManager::getKeyFromTuple(const void *data, const vector<Attribute> &recordDescriptor, int32_t pos, void *key) {
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    const char *nullBits = static_cast<const char *>(data);
+    unsigned offset = rbfm->getNullIndicatorSize(recordDescriptor.size());
+
+    for (int32_t i = 0; i <= pos; i++) {
+        int indicatorIndex = i / CHAR_BIT;
+        int indicatorMask = 1 << (CHAR_BIT - 1 - (i % CHAR_BIT));
+        bool isNull = (nullBits[indicatorIndex] & indicatorMask) != 0;
+        if (i == pos && isNull)
+            return false;
+        if (isNull)
+            continue;
+
+        unsigned size;
+        switch (recordDescriptor[i].type) {
+            case TypeInt:
+                size = INT_SIZE;
+                break;
+            case TypeReal:
+                size = REAL_SIZE;
+                break;
+            case TypeVarChar: {
+                int32_t varcharSize;
+                memcpy(&varcharSize, static_cast<const char *>(data) + offset, VARCHAR_LENGTH_SIZE);
+                size = VARCHAR_LENGTH_SIZE + varcharSize;
+                break;
+            }
+        }
+        if (i == pos)
+            memcpy(key, static_cast<const char *>(data) + offset, size);
+        offset += size;
+    }
+    return true;
 }
 
 // Get the next table ID for creating a table
@@ -990,6 +1036,17 @@ RC RelationManager::getNextTableID(int32_t &table_id) {
 
 // Gets the table ID of the given tableName
 RC RelationManager::getTableID(const string &tableName, int32_t &tableID) {
+    CatalogEntry *entry;
+    RC rc = getCatalogEntry(tableName, entry);
+    if (rc)
+        return rc;
+
+    tableID = entry->tableID;
+    return SUCCESS;
+}
+
+// Looks up the table-id of tableName in the Tables table
+RC RelationManager::loadTableID(const string &tableName, int32_t &tableID) {
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     FileHandle fileHandle;
     RC rc;
@@ -1028,8 +1085,131 @@ RC RelationManager::getTableID(const string &tableName, int32_t &tableID) {
     return rc;
 }
 
+// Returns an open handle on the table file fileName, opening it if it isn't open already.
+// The handle stays owned by the RelationManager and is only valid until the next call that opens a file.
+RC RelationManager::getFileHandle(const string &fileName, FileHandle *&fileHandle) {
+    OpenFile *file;
+    RC rc = getOpenFile(fileName, false, file);
+    if (rc)
+        return rc;
+
+    fileHandle = &file->fileHandle;
+    return SUCCESS;
+}
+
+// Same as getFileHandle for index files
+RC RelationManager::getIXFileHandle(const string &fileName, IXFileHandle *&ixFileHandle) {
+    OpenFile *file;
+    RC rc = getOpenFile(fileName, true, file);
+    if (rc)
+        return rc;
+
+    ixFileHandle = &file->ixFileHandle;
+    return SUCCESS;
+}
+
+RC RelationManager::getOpenFile(const string &fileName, bool isIndex, OpenFile *&file) {
+    // Move a cached file to the front of the LRU list
+    auto cached = openFileMap.find(fileName);
+    if (cached != openFileMap.end()) {
+        openFiles.splice(openFiles.begin(), openFiles, cached->second);
+        file = &openFiles.front();
+        return SUCCESS;
+    }
+
+    // Make room by closing the least recently used file
+    if (openFiles.size() >= RM_OPEN_FILES_MAX)
+        closeOpenFile(openFiles.back().fileName);
+
+    openFiles.emplace_front();
+    OpenFile &opened = openFiles.front();
+    opened.fileName = fileName;
+    opened.isIndex = isIndex;
+
+    RC rc;
+    if (isIndex)
+        rc = IndexManager::instance()->openFile(fileName, opened.ixFileHandle);
+    else
+        rc = RecordBasedFileManager::instance()->openFile(fileName, opened.fileHandle);
+    if (rc) {
+        openFiles.pop_front();
+        return rc;
+    }
+
+    openFileMap[fileName] = openFiles.begin();
+    file = &opened;
+    return SUCCESS;
+}
+
+// Closes fileName if it is in the open file cache. Must be called before the file is created or destroyed
+RC RelationManager::closeOpenFile(const string &fileName) {
+    auto cached = openFileMap.find(fileName);
+    if (cached == openFileMap.end())
+        return SUCCESS;
+
+    OpenFile &file = *cached->second;
+    RC rc;
+    if (file.isIndex)
+        rc = IndexManager::instance()->closeFile(file.ixFileHandle);
+    else
+        rc = RecordBasedFileManager::instance()->closeFile(file.fileHandle);
+
+    openFiles.erase(cached->second);
+    openFileMap.erase(cached);
+    return rc;
+}
+
+RC RelationManager::closeOpenFiles() {
+    RC rc = SUCCESS;
+    while (!openFiles.empty()) {
+        RC closed = closeOpenFile(openFiles.front().fileName);
+        if (closed)
+            rc = closed;
+    }
+    return rc;
+}
+
+// Returns the cached catalog entry for tableName, reading it from the catalog tables on the first use
+RC RelationManager::getCatalogEntry(const string &tableName, CatalogEntry *&entry) {
+    auto cached = catalogCache.find(tableName);
+    if (cached != catalogCache.end()) {
+        entry = &cached->second;
+        return SUCCESS;
+    }
+
+    CatalogEntry loaded;
+    RC rc;
+    rc = loadTableID(tableName, loaded.tableID);
+    if (rc)
+        return rc;
+    rc = loadSystemFlag(loaded.system, tableName);
+    if (rc)
+        return rc;
+    rc = loadAttributes(loaded.tableID, loaded.recordDescriptor);
+    if (rc)
+        return rc;
+    rc = loadIndexedAttributes(tableName, loaded.recordDescriptor, loaded.indexedAttrs);
+    if (rc)
+        return rc;
+    loaded.fileName = getFileName(tableName);
+
+    entry = &(catalogCache[tableName] = loaded);
+    return SUCCESS;
+}
+
 // Determine if table tableName is a system table. Set the boolean argument as the result
 RC RelationManager::isSystemTable(bool &system, const string &tableName) {
+    CatalogEntry *entry;
+    RC rc = getCatalogEntry(tableName, entry);
+    if (rc)
+        return rc;
+
+    system = entry->system;
+    return SUCCESS;
+}
+
+// Reads the system flag of tableName from the Tables table
+RC RelationManager::loadSystemFlag(bool &system, const string &tableName) {
     RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
     FileHandle fileHandle;
     RC rc;
@@ -1145,20 +1325,20 @@ RC RelationManager::scan(const string &tableName,
                          const void *value,
                          const vector<string> &attributeNames,
                          RM_ScanIterator &rm_ScanIterator) {
-    // Open the file for the given tableName
-    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
-    RC rc = rbfm->openFile(getFileName(tableName), rm_ScanIterator.fileHandle);
+    // Look up the table in the catalog
+    CatalogEntry *entry;
+    RC rc = getCatalogEntry(tableName, entry);
     if (rc)
         return rc;
 
-    // grab the record descriptor for the given tableName
-    vector<Attribute> recordDescriptor;
-    rc = getAttributes(tableName, recordDescriptor);
+    // Open the file for the given tableName
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    rc = rbfm->openFile(entry->fileName, rm_ScanIterator.fileHandle);
     if (rc)
         return rc;
 
     // Use the underlying rbfm_scaniterator to do all the work
-    rc = rbfm->scan(rm_ScanIterator.fileHandle, recordDescriptor, conditionAttribute,
+    rc = rbfm->scan(rm_ScanIterator.fileHandle, entry->recordDescriptor, conditionAttribute,
                     compOp, value, attributeNames, rm_ScanIterator.rbfm_iter);
     if (rc)
         return rc;
@@ -1193,10 +1373,11 @@ RC RelationManager::indexScan(const string &tableName,
     if (rc) return rc;
 
     //get attributes
-    vector<Attribute> recordDescriptor;
-    rc = getAttributes(tableName, recordDescriptor);
+    CatalogEntry *entry;
+    rc = getCatalogEntry(tableName, entry);
     if (rc)
         return rc;
+    vector<Attribute> &recordDescriptor = entry->recordDescriptor;
 
     //iterate until you find attribute that matches the attributeName
     for(unsigned i = 0; i < recordDescriptor.size(); i++) {
@@ -1217,6 +1398,10 @@ RC RM_IndexScanIterator::getNextEntry(RID &rid, void* key) {
     return ix_iter.getNextEntry(rid, key);
 }
 
+RC RM_IndexScanIterator::reset(const void *lowKey, const void *highKey, bool lowKeyInclusive, bool highKeyInclusive) {
+    return ix_iter.reset(lowKey, highKey, lowKeyInclusive, highKeyInclusive);
+}
+
 RC RM_IndexScanIterator::close() {
     IndexManager *im = IndexManager::instance();
     ix_iter.close();
@@ -2,7 +2,9 @@
 #ifndef _rm_h_
 #define _rm_h_
 
+#include <list>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "../ix/ix.h"
@@ -57,6 +59,9 @@ using namespace std;
 
 #define RM_EOF (-1)  // end of a scan operator
 
+// Number of table and index files the RelationManager keeps open between operations
+#define RM_OPEN_FILES_MAX 32
+
 #define RM_CANNOT_MOD_SYS_TBL 1
 #define RM_NULL_COLUMN 2
 
@@ -65,6 +70,23 @@ typedef struct IndexedAttr {
     Attribute attr;
 } IndexedAttr;
 
+// What the catalog holds about one table, cached by the RelationManager
+typedef struct CatalogEntry {
+    int32_t tableID;
+    bool system;
+    string fileName;
+    vector<Attribute> recordDescriptor;
+    vector<IndexedAttr> indexedAttrs;  // pos is the attribute's position in recordDescriptor
+} CatalogEntry;
+
+// A table or index file kept open by the RelationManager
+typedef struct OpenFile {
+    string fileName;
+    bool isIndex;
+    FileHandle fileHandle;      // Set for tables
+    IXFileHandle ixFileHandle;  // Set for indexes
+} OpenFile;
+
 // RM_ScanIterator is an iteratr to go through tuples
 class RM_ScanIterator {
    public:
@@ -90,6 +112,10 @@ class RM_IndexScanIterator {
 
     // "key" follows the same format as in IndexManager::insertEntry()
     RC getNextEntry(RID &rid, void *key);  // Get next matching entry
+    RC reset(const void *lowKey,           // Start over with a new key range without reopening the index
+             const void *highKey,
+             bool lowKeyInclusive,
+             bool highKeyInclusive);
     RC close();             // Terminate index scan
     friend class RelationManager;
 
@@ -115,6 +141,10 @@ class RelationManager {
 
     RC insertTuple(const string &tableName, const void *data, RID &rid);
 
+    // Insert every tuple of the batch, returning their RIDs in the same order.
+    // The schema and indexes are looked up once and each index is updated in a single pass.
+    RC insertTuples(const string &tableName, const vector<const void *> &tuples, vector<RID> &rids);
+
     RC deleteTuple(const string &tableName, const RID &rid);
 
     RC updateTuple(const string &tableName, const void *data, const RID &rid);
@@ -159,6 +189,13 @@ class RelationManager {
     const vector<Attribute> columnDescriptor;
     const vector<Attribute> indexDescriptor;
 
+    // Catalog entries by table name. Dropped whenever a table or index is created or deleted
+    unordered_map<string, CatalogEntry> catalogCache;
+
+    // Open files, most recently used first, and their position in that list by file name
+    list<OpenFile> openFiles;
+    unordered_map<string, list<OpenFile>::iterator> openFileMap;
+
     // Convert tableName to file name (append extension)
     static string getFileName(const char *tableName);
     static string getFileName(const string &tableName);
@@ -186,10 +223,28 @@ class RelationManager {
 
     RC isSystemTable(bool &system, const string &tableName);
 
+    // Get a handle from the open file cache, opening the file on a miss
+    RC getFileHandle(const string &fileName, FileHandle *&fileHandle);
+    RC getIXFileHandle(const string &fileName, IXFileHandle *&ixFileHandle);
+    RC getOpenFile(const string &fileName, bool isIndex, OpenFile *&file);
+    // Close cached files, before they are dropped or recreated
+    RC closeOpenFile(const string &fileName);
+    RC closeOpenFiles();
+
+    // Get the cached catalog entry for tableName, reading it in on a miss
+    RC getCatalogEntry(const string &tableName, CatalogEntry *&entry);
+    // Read the parts of a catalog entry from the catalog tables
+    RC loadTableID(const string &tableName, int32_t &tableID);
+    RC loadSystemFlag(bool &system, const string &tableName);
+    RC loadAttributes(int32_t id, vector<Attribute> &attrs);
+    RC loadIndexedAttributes(const string &tableName, const vector<Attribute> &recordDescriptor, vector<IndexedAttr> &indexedAttrs);
+
     //private extension functions
     RC insertIndex(const string &tableName, const string &attributeName);
     RC insertExtension(void *data, vector<Attribute> &recordDescriptor, const string &tableName, RID &rid);
     RC deleteExtension(void *data, vector<Attribute> &recordDescriptor, const string &tableName, const RID &rid);
+    RC getIndexedAttributes(const string &tableName, vector<IndexedAttr> &indexedAttrs);
+    bool getKeyFromTuple(const void *data, const vector<Attribute> &recordDescriptor, int32_t pos, void *key);
 
     // Utility functions for converting single values to/from api format
     // Useful when using ScanIterators
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <vector>
 
 #include "qe_test_util.h"
@@ -22,6 +23,78 @@ void print_right_tuple(void *data) {
     cerr << setw(7) << *(int *)((float *)data + 8 + 1) << " | ";
 }
 
+// Field i of a tuple whose fields are all 4 bytes long, or NULL if the field is null
+const char *get_field(const void *data, int fieldCount, int i) {
+    const unsigned char *nullsIndicator = (const unsigned char *)data;
+    int offset = getActualByteForNullsIndicator(fieldCount);
+    for (int j = 0; j < i; ++j) {
+        if (!(nullsIndicator[j / 8] & (1 << (7 - j % 8)))) offset += 4;
+    }
+    if (nullsIndicator[i / 8] & (1 << (7 - i % 8))) return NULL;
+    return (const char *)data + offset;
+}
+
+// Order two fields the way Sort does, with NULL first
+template <typename T>
+int compare_fields(const char *lhs, const char *rhs) {
+    if (lhs == NULL || rhs == NULL) return (lhs != NULL) - (rhs != NULL);
+    T l = *(const T *)lhs;
+    T r = *(const T *)rhs;
+    return (l > r) - (l < r);
+}
+
+//Large tables ---------------------------------------------------------------
+
+// Enough tuples that joins and sorts over them don't fit in memory
+const int largeLeftCount = 120000;
+const int largeRightCount = 30000;
+
+// largeleft: a in [0, 119999], b = a % 40000, c = a % 5. b is NULL for every 50th tuple, c whenever it would be 4
+bool large_left_b(int a, int &b) {
+    b = a % 40000;
+    return a % 50 != 49;
+}
+
+bool large_left_c(int a, float &c) {
+    c = (float)(a % 5);
+    return a % 5 != 4;
+}
+
+// largeright: d in [0, 29999], b = 2 * (d % 15000) so every b appears twice, c = d
+int large_right_b(int d) {
+    return 2 * (d % 15000);
+}
+
+// Count the rows of largeleft JOIN largeright ON largeleft.B = largeright.B, checking them against the tables
+void print_large_join(Iterator *join) {
+    void *data = malloc(bufSize);
+
+    // Expected rows, with a sum over them that changes if any row is missing, repeated or wrong
+    map<int, vector<int> > rightByB;
+    for (int d = 0; d < largeRightCount; ++d) rightByB[large_right_b(d)].push_back(d);
+    long expectedRows = 0;
+    unsigned long long expectedSum = 0;
+    for (int a = 0; a < largeLeftCount; ++a) {
+        int b;
+        if (!large_left_b(a, b) || !rightByB.count(b)) continue;
+        for (int d : rightByB[b]) {
+            expectedRows++;
+            expectedSum += (unsigned long long)a * largeRightCount + d;
+        }
+    }
+
+    long rows = 0;
+    unsigned long long sum = 0;
+    while (join->getNextTuple(data) != QE_EOF) {
+        const char *a = get_field(data, 6, 0);
+        const char *d = get_field(data, 6, 5);
+        rows++;
+        if (a != NULL && d != NULL) sum += (unsigned long long)*(int *)a * largeRightCount + *(int *)d;
+    }
+
+    cerr << rows << " rows (expected " << expectedRows << "), checksum " << (sum == expectedSum ? "matches" : "differs") << endl;
+}
+
 //Query examples -------------------------------------------------------------
 
 // SELECT * from left
@@ -88,8 +161,228 @@ void print_join() {
     }
 }
 
+// SELECT largeleft.B, SUM(largeleft.C) from largeleft GROUP BY largeleft.B
+void print_aggregate() {
+    void *data = malloc(bufSize);
+
+    // Expected sum and number of non-NULL values in each group, with the NULL group under -1
+    map<int, pair<float, int> > expected;
+    for (int a = 0; a < largeLeftCount; ++a) {
+        int b;
+        float c;
+        pair<float, int> &group = expected[large_left_b(a, b) ? b : -1];
+        if (large_left_c(a, c)) {
+            group.first += c;
+            group.second++;
+        }
+    }
+
+    Attribute aggAttr = {"largeleft.C", TypeReal, 4};
+    Attribute groupAttr = {"largeleft.B", TypeInt, 4};
+    Aggregate *agg = new Aggregate(new TableScan(*rm, "largeleft"), aggAttr, groupAttr, SUM);
+
+    int groups = 0;
+    int correct = 0;
+    while (agg->getNextTuple(data) != QE_EOF) {
+        const char *group = get_field(data, 2, 0);
+        const char *sum = get_field(data, 2, 1);
+        groups++;
+
+        auto entry = expected.find(group != NULL ? *(int *)group : -1);
+        if (entry == expected.end()) continue;
+        // A group whose values are all NULL sums to NULL
+        if (entry->second.second == 0 ? sum == NULL : sum != NULL && *(float *)sum == entry->second.first) correct++;
+    }
+
+    cerr << groups << " groups (expected " << expected.size() << "), " << correct << " with the expected sum" << endl;
+}
+
+// SELECT * from largeleft, largeright WHERE largeleft.B = largeright.B
+void print_gh_join() {
+    TableScan *leftIn = new TableScan(*rm, "largeleft");
+    TableScan *rightIn = new TableScan(*rm, "largeright");
+
+    Condition cond;
+    cond.lhsAttr = "largeleft.B";
+    cond.op = EQ_OP;
+    cond.bRhsIsAttr = true;
+    cond.rhsAttr = "largeright.B";
+
+    // largeleft is too big to hash in memory, so both tables are partitioned first
+    GHJoin *ghJoin = new GHJoin(leftIn, rightIn, cond);
+    print_large_join(ghJoin);
+
+    // Removes the partitions
+    delete ghJoin;
+}
+
+// SELECT * from largeleft, right WHERE largeleft.B < right.B
+void print_bnl_join() {
+    void *data = malloc(bufSize);
+
+    // Expected rows, against the tuples of right read into memory
+    vector<int> rightB;
+    TableScan *rightScan = new TableScan(*rm, "right");
+    while (rightScan->getNextTuple(data) != QE_EOF) {
+        const char *b = get_field(data, 3, 0);
+        if (b != NULL) rightB.push_back(*(int *)b);
+    }
+    long expectedRows = 0;
+    for (int a = 0; a < largeLeftCount; ++a) {
+        int b;
+        if (!large_left_b(a, b)) continue;
+        for (int rb : rightB) {
+            if (b < rb) expectedRows++;
+        }
+    }
+
+    TableScan *leftIn = new TableScan(*rm, "largeleft");
+    TableScan *rightIn = new TableScan(*rm, "right");
+
+    Condition cond;
+    cond.lhsAttr = "largeleft.B";
+    cond.op = LT_OP;
+    cond.bRhsIsAttr = true;
+    cond.rhsAttr = "right.B";
+
+    // A block of 4 pages holds about a thousand tuples of largeleft, so right is read over a hundred times
+    BNLJoin *bnlJoin = new BNLJoin(leftIn, rightIn, cond, 4);
+
+    long rows = 0;
+    long wrong = 0;
+    while (bnlJoin->getNextTuple(data) != QE_EOF) {
+        const char *lb = get_field(data, 6, 1);
+        const char *rb = get_field(data, 6, 3);
+        rows++;
+        if (lb == NULL || rb == NULL || *(int *)lb >= *(int *)rb) wrong++;
+    }
+
+    cerr << rows << " rows (expected " << expectedRows << "), " << wrong << " not satisfying the condition" << endl;
+}
+
+// SELECT * from largeleft ORDER BY largeleft.C, largeleft.B DESC
+void print_sort() {
+    void *data = malloc(bufSize);
+    void *prev = malloc(bufSize);
+
+    vector<SortKey> keys = {{"largeleft.C", true}, {"largeleft.B", false}};
+
+    // Runs of 3 pages are merged two at a time, over several passes
+    Sort *sort = new Sort(new TableScan(*rm, "largeleft"), keys, 3);
+
+    long rows = 0;
+    long outOfOrder = 0;
+    while (sort->getNextTuple(data) != QE_EOF) {
+        if (rows++ > 0) {
+            int cmp = compare_fields<float>(get_field(prev, 3, 2), get_field(data, 3, 2));
+            if (cmp == 0) cmp = -compare_fields<int>(get_field(prev, 3, 1), get_field(data, 3, 1));
+            // Tuples with equal keys keep the order they were scanned in, which is by A
+            if (cmp == 0) cmp = compare_fields<int>(get_field(prev, 3, 0), get_field(data, 3, 0));
+            if (cmp >= 0) outOfOrder++;
+        }
+        memcpy(prev, data, bufSize);
+    }
+
+    cerr << rows << " rows (expected " << largeLeftCount << "), " << outOfOrder << " out of order" << endl;
+
+    // Removes the runs
+    delete sort;
+}
+
+// SELECT * from largeleft, largeright WHERE largeleft.B = largeright.B, joining both tables in order of B
+void print_sm_join() {
+    vector<SortKey> leftKeys = {{"largeleft.B", true}};
+    vector<SortKey> rightKeys = {{"largeright.B", true}};
+    Sort *leftIn = new Sort(new TableScan(*rm, "largeleft"), leftKeys);
+    Sort *rightIn = new Sort(new TableScan(*rm, "largeright"), rightKeys);
+
+    Condition cond;
+    cond.lhsAttr = "largeleft.B";
+    cond.op = EQ_OP;
+    cond.bRhsIsAttr = true;
+    cond.rhsAttr = "largeright.B";
+
+    // Every value of B is shared by up to three tuples of largeleft and two of largeright
+    SMJoin *smJoin = new SMJoin(leftIn, rightIn, cond);
+    print_large_join(smJoin);
+
+    // Removes the runs
+    delete leftIn;
+    delete rightIn;
+}
+
+// SELECT * from right WHERE right.C = k, with one IndexScan reused while tuples are inserted into right
+void print_index_lookups() {
+    void *data = malloc(bufSize);
+    const int insertCount = 20000;
+
+    IndexScan *rightIn = new IndexScan(*rm, "right", "C");
+    float key = 50.0;
+    rightIn->setIterator(&key, &key, true, true);
+    while (rightIn->getNextTuple(data) != QE_EOF) {
+    }
+
+    // Insert enough tuples to split the pages of the index behind the open scan
+    vector<Attribute> attrs;
+    rm->getAttributes("right", attrs);
+    unsigned char nullsIndicator = 0;
+    RID rid;
+    for (int i = 0; i < insertCount; ++i) {
+        memset(data, 0, bufSize);
+        prepareRightTuple(attrs.size(), &nullsIndicator, i + 1000, (float)(i + 1000), i, data);
+        rm->insertTuple("right", data, rid);
+    }
+
+    // Every new key should be found again through the same scan
+    int probes = 0;
+    int found = 0;
+    for (int i = 0; i < insertCount; i += 97) {
+        key = (float)(i + 1000);
+        rightIn->setIterator(&key, &key, true, true);
+        probes++;
+
+        int matches = 0;
+        while (rightIn->getNextTuple(data) != QE_EOF) {
+            if (*(float *)((char *)data + 4 + 1) == key) matches++;
+        }
+        if (matches == 1) found++;
+    }
+
+    cerr << found << " of " << probes << " inserted keys found" << endl;
+}
+
 //Creating tables ------------------------------------------------------------
 
+void populateLargeTables() {
+    void *buf = malloc(bufSize);
+    RID rid;
+
+    vector<Attribute> attrs;
+    rm->getAttributes("largeleft", attrs);
+    for (int a = 0; a < largeLeftCount; ++a) {
+        int b;
+        float c;
+        unsigned char nullsIndicator = 0;
+        if (!large_left_b(a, b)) nullsIndicator |= 1 << 6;
+        if (!large_left_c(a, c)) nullsIndicator |= 1 << 5;
+
+        memset(buf, 0, bufSize);
+        prepareLeftTuple(attrs.size(), &nullsIndicator, a, b, c, buf);
+        rm->insertTuple("largeleft", buf, rid);
+    }
+
+    rm->getAttributes("largeright", attrs);
+    for (int d = 0; d < largeRightCount; ++d) {
+        unsigned char nullsIndicator = 0;
+
+        memset(buf, 0, bufSize);
+        prepareRightTuple(attrs.size(), &nullsIndicator, large_right_b(d), (float)d, d, buf);
+        rm->insertTuple("largeright", buf, rid);
+    }
+
+    free(buf);
+}
+
 void setupTables() {
     rm->deleteCatalog();
     rm->createCatalog();
@@ -100,6 +393,10 @@ void setupTables() {
     createRightTable();
     populateRightTable();
     createIndexforRightC();
+
+    createLargeLeftTable();
+    createLargeRightTable();
+    populateLargeTables();
 }
 
 //Create tables and demonstrate functionality using INLJoin
@@ -117,5 +414,23 @@ int main() {
     cerr << "\nSELECT * from left, right WHERE left.C = right.C:\n";
     print_join();  // SELECT * from left, right WHERE left.C = right.C
 
+    cerr << "\nSELECT largeleft.B, SUM(largeleft.C) from largeleft GROUP BY largeleft.B:\n";
+    print_aggregate();  // SELECT largeleft.B, SUM(largeleft.C) from largeleft GROUP BY largeleft.B
+
+    cerr << "\nSELECT * from largeleft, largeright WHERE largeleft.B = largeright.B with a Grace hash join:\n";
+    print_gh_join();  // SELECT * from largeleft, largeright WHERE largeleft.B = largeright.B
+
+    cerr << "\nSELECT * from largeleft, right WHERE largeleft.B < right.B:\n";
+    print_bnl_join();  // SELECT * from largeleft, right WHERE largeleft.B < right.B
+
+    cerr << "\nSELECT * from largeleft ORDER BY largeleft.C, largeleft.B DESC:\n";
+    print_sort();  // SELECT * from largeleft ORDER BY largeleft.C, largeleft.B DESC
+
+    cerr << "\nSELECT * from largeleft, largeright WHERE largeleft.B = largeright.B with a sort-merge join:\n";
+    print_sm_join();  // SELECT * from largeleft, largeright WHERE largeleft.B = largeright.B
+
+    cerr << "\nSELECT * from right WHERE right.C = k after inserting into right:\n";
+    print_index_lookups();  // SELECT * from right WHERE right.C = k
+
     return EXIT_SUCCESS;
 }